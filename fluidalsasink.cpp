@@ -0,0 +1,320 @@
+/*
+    Drumstick RT (realtime MIDI In/Out) FluidLite Backend
+    Copyright (C) 2022, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QtGlobal>
+#include <cerrno>
+#include <cstring>
+
+#include "fluidalsasink.h"
+#include "fluidrenderer.h"
+
+static const int WAIT_TIMEOUT = 100; // ms, to notice the interruption requests
+
+FluidAlsaSink::FluidAlsaSink(FluidRenderer *renderer, QObject *parent):
+    QThread(parent),
+    m_renderer(renderer),
+    m_pcm(nullptr),
+    m_sampleRate(0),
+    m_frameBytes(0),
+    m_periodFrames(0),
+    m_periods(0),
+    m_bufferFrames(0),
+    m_sampleFormat(FluidSampleConverter::Float),
+    m_carryFrames(0),
+    m_framesWritten(0),
+    m_framesPlayed(0),
+    m_xruns(0),
+    m_suspended(false)
+{
+    //qDebug() << Q_FUNC_INFO;
+}
+
+FluidAlsaSink::~FluidAlsaSink()
+{
+    close();
+    //qDebug() << Q_FUNC_INFO;
+}
+
+/**
+ * Opens the device for interleaved mmap access, with the sample format
+ * closest to the rendered one: float, then 32, 24 and 16 bit integers. The
+ * rate, period size and count may be adjusted to the nearest the device
+ * supports, see sampleRate(), periodFrames() and periods().
+ */
+bool FluidAlsaSink::open(const QString &device, int sampleRate, int channels, int periodFrames, int periods)
+{
+    static const struct {
+        FluidSampleConverter::Format format;
+        snd_pcm_format_t alsaFormat;
+    } FORMATS[] = {
+        { FluidSampleConverter::Float, SND_PCM_FORMAT_FLOAT },
+        { FluidSampleConverter::Int32, SND_PCM_FORMAT_S32 },
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+        { FluidSampleConverter::Int24, SND_PCM_FORMAT_S24_3LE },
+#else
+        { FluidSampleConverter::Int24, SND_PCM_FORMAT_S24_3BE },
+#endif
+        { FluidSampleConverter::Int16, SND_PCM_FORMAT_S16 }
+    };
+    close();
+    int err = snd_pcm_open(&m_pcm, device.toLocal8Bit().constData(), SND_PCM_STREAM_PLAYBACK, 0);
+    if (err < 0) {
+        m_pcm = nullptr;
+        m_errorString = tr("Cannot open the ALSA device %1: %2").arg(device, QString::fromLocal8Bit(snd_strerror(err)));
+        return false;
+    }
+    snd_pcm_hw_params_t *hwParams;
+    snd_pcm_hw_params_alloca(&hwParams);
+    snd_pcm_hw_params_any(m_pcm, hwParams);
+    if ((err = snd_pcm_hw_params_set_access(m_pcm, hwParams, SND_PCM_ACCESS_MMAP_INTERLEAVED)) < 0) {
+        m_errorString = tr("The ALSA device %1 has no mmap access: %2").arg(device, QString::fromLocal8Bit(snd_strerror(err)));
+        close();
+        return false;
+    }
+    err = -EINVAL;
+    for (const auto &candidate : FORMATS) {
+        if (snd_pcm_hw_params_test_format(m_pcm, hwParams, candidate.alsaFormat) == 0) {
+            err = snd_pcm_hw_params_set_format(m_pcm, hwParams, candidate.alsaFormat);
+            m_sampleFormat = candidate.format;
+            break;
+        }
+    }
+    if (err < 0 || (err = snd_pcm_hw_params_set_channels(m_pcm, hwParams, channels)) < 0) {
+        m_errorString = tr("Unsupported sample format or %1 channels on the ALSA device %2: %3")
+                        .arg(channels).arg(device, QString::fromLocal8Bit(snd_strerror(err)));
+        close();
+        return false;
+    }
+    unsigned int rate = sampleRate;
+    snd_pcm_uframes_t period = periodFrames;
+    m_periods = periods;
+    snd_pcm_hw_params_set_rate_near(m_pcm, hwParams, &rate, nullptr);
+    snd_pcm_hw_params_set_period_size_near(m_pcm, hwParams, &period, nullptr);
+    snd_pcm_hw_params_set_periods_near(m_pcm, hwParams, &m_periods, nullptr);
+    if ((err = snd_pcm_hw_params(m_pcm, hwParams)) < 0) {
+        m_errorString = tr("Cannot configure the ALSA device %1: %2").arg(device, QString::fromLocal8Bit(snd_strerror(err)));
+        close();
+        return false;
+    }
+    snd_pcm_hw_params_get_rate(hwParams, &rate, nullptr);
+    snd_pcm_hw_params_get_period_size(hwParams, &m_periodFrames, nullptr);
+    snd_pcm_hw_params_get_periods(hwParams, &m_periods, nullptr);
+    snd_pcm_hw_params_get_buffer_size(hwParams, &m_bufferFrames);
+    m_sampleRate = static_cast<int>(rate);
+
+    /* starts playing once the whole buffer is filled, and wakes up every period */
+    snd_pcm_sw_params_t *swParams;
+    snd_pcm_sw_params_alloca(&swParams);
+    snd_pcm_sw_params_current(m_pcm, swParams);
+    snd_pcm_sw_params_set_start_threshold(m_pcm, swParams, m_bufferFrames);
+    snd_pcm_sw_params_set_avail_min(m_pcm, swParams, m_periodFrames);
+    if ((err = snd_pcm_sw_params(m_pcm, swParams)) < 0) {
+        m_errorString = tr("Cannot configure the ALSA device %1: %2").arg(device, QString::fromLocal8Bit(snd_strerror(err)));
+        close();
+        return false;
+    }
+    m_frameBytes = channels * FluidSampleConverter::sampleBytes(m_sampleFormat);
+    m_carry.assign(static_cast<size_t>(m_renderer->renderingFrames()) * m_frameBytes, 0);
+    m_carryFrames = 0;
+    m_framesWritten = 0;
+    m_framesPlayed.store(0, std::memory_order_relaxed);
+    return true;
+}
+
+void FluidAlsaSink::close()
+{
+    stop();
+    if (m_pcm != nullptr) {
+        snd_pcm_close(m_pcm);
+        m_pcm = nullptr;
+    }
+}
+
+void FluidAlsaSink::stop()
+{
+    //qDebug() << Q_FUNC_INFO;
+    if (isRunning()) {
+        requestInterruption();
+        m_resumed.release();
+        wait();
+    }
+}
+
+/* while suspended, the device is stopped and the renderer is not pulled */
+void FluidAlsaSink::setSuspended(bool suspended)
+{
+    m_suspended.store(suspended, std::memory_order_release);
+    if (!suspended) {
+        m_resumed.release();
+    }
+}
+
+int FluidAlsaSink::sampleRate() const
+{
+    return m_sampleRate;
+}
+
+int FluidAlsaSink::periodFrames() const
+{
+    return static_cast<int>(m_periodFrames);
+}
+
+int FluidAlsaSink::periods() const
+{
+    return static_cast<int>(m_periods);
+}
+
+/* the buffer size in milliseconds */
+int FluidAlsaSink::bufferTime() const
+{
+    return m_sampleRate > 0 ? static_cast<int>(m_bufferFrames * 1000 / m_sampleRate) : 0;
+}
+
+FluidSampleConverter::Format FluidAlsaSink::sampleFormat() const
+{
+    return m_sampleFormat;
+}
+
+/* the time already played by the device, safe to call from any thread */
+qint64 FluidAlsaSink::processedUSecs() const
+{
+    return m_sampleRate > 0 ? m_framesPlayed.load(std::memory_order_relaxed) * 1000000 / m_sampleRate : 0;
+}
+
+quint64 FluidAlsaSink::xruns() const
+{
+    return m_xruns.load(std::memory_order_relaxed);
+}
+
+QString FluidAlsaSink::errorString() const
+{
+    return m_errorString;
+}
+
+/**
+ * Fills frames in the output sample format: the rest of the block rendered
+ * last time first, then whole blocks, and the start of one more block when
+ * the area ends in the middle of it.
+ */
+void FluidAlsaSink::fill(char *dest, int frames)
+{
+    const int block = m_renderer->renderingFrames();
+    while (frames > 0) {
+        if (m_carryFrames > 0) {
+            const int count = qMin(frames, m_carryFrames);
+            std::memcpy(dest, m_carry.data() + (block - m_carryFrames) * m_frameBytes, count * m_frameBytes);
+            m_carryFrames -= count;
+            dest += count * m_frameBytes;
+            frames -= count;
+        } else if (frames >= block) {
+            const qint64 bytes = m_renderer->read(dest, static_cast<qint64>(frames / block) * block * m_frameBytes);
+            if (bytes <= 0) {
+                break;
+            }
+            dest += bytes;
+            frames -= static_cast<int>(bytes / m_frameBytes);
+        } else {
+            if (m_renderer->read(m_carry.data(), static_cast<qint64>(m_carry.size())) <= 0) {
+                break;
+            }
+            m_carryFrames = block;
+        }
+    }
+    if (frames > 0) {
+        std::memset(dest, 0, static_cast<size_t>(frames) * m_frameBytes);
+    }
+}
+
+/* an underrun (EPIPE) is reported, and the device is prepared again */
+void FluidAlsaSink::recover(int err)
+{
+    if (err == -EPIPE) {
+        m_xruns.fetch_add(1, std::memory_order_relaxed);
+        emit underrunDetected();
+    }
+    err = snd_pcm_recover(m_pcm, err, 1);
+    if (err < 0) {
+        m_errorString = tr("ALSA playback error: %1").arg(QString::fromLocal8Bit(snd_strerror(err)));
+        m_renderer->appendDiagnostics(fluid_log_level::FLUID_ERR, qPrintable(m_errorString));
+        requestInterruption();
+    }
+}
+
+void FluidAlsaSink::run()
+{
+    //qDebug() << Q_FUNC_INFO;
+    if (m_pcm == nullptr) {
+        return;
+    }
+    while (!isInterruptionRequested()) {
+        if (m_suspended.load(std::memory_order_acquire)) {
+            snd_pcm_drop(m_pcm);
+            while (m_suspended.load(std::memory_order_acquire) && !isInterruptionRequested()) {
+                m_resumed.tryAcquire(1, WAIT_TIMEOUT);
+            }
+            snd_pcm_prepare(m_pcm);
+            continue;
+        }
+        const snd_pcm_sframes_t avail = snd_pcm_avail_update(m_pcm);
+        if (avail < 0) {
+            recover(static_cast<int>(avail));
+            continue;
+        }
+        if (static_cast<snd_pcm_uframes_t>(avail) < m_periodFrames) {
+            if (snd_pcm_state(m_pcm) == SND_PCM_STATE_PREPARED) {
+                /* the buffer is as full as it gets */
+                const int err = snd_pcm_start(m_pcm);
+                if (err < 0) {
+                    recover(err);
+                }
+                continue;
+            }
+            const int err = snd_pcm_wait(m_pcm, WAIT_TIMEOUT);
+            if (err < 0) {
+                recover(err);
+            }
+            continue;
+        }
+        snd_pcm_uframes_t remaining = static_cast<snd_pcm_uframes_t>(avail);
+        while (remaining > 0) {
+            const snd_pcm_channel_area_t *areas;
+            snd_pcm_uframes_t offset;
+            snd_pcm_uframes_t frames = remaining;
+            int err = snd_pcm_mmap_begin(m_pcm, &areas, &offset, &frames);
+            if (err < 0) {
+                recover(err);
+                break;
+            }
+            /* interleaved: all the channels share the first area */
+            char *dest = static_cast<char *>(areas[0].addr) + areas[0].first / 8 + offset * areas[0].step / 8;
+            fill(dest, static_cast<int>(frames));
+            const snd_pcm_sframes_t committed = snd_pcm_mmap_commit(m_pcm, offset, frames);
+            if (committed < 0 || static_cast<snd_pcm_uframes_t>(committed) != frames) {
+                recover(committed < 0 ? static_cast<int>(committed) : -EPIPE);
+                break;
+            }
+            m_framesWritten += frames;
+            remaining -= frames;
+        }
+        snd_pcm_sframes_t delay = 0;
+        if (snd_pcm_delay(m_pcm, &delay) == 0) {
+            m_framesPlayed.store(qMax<qint64>(0, m_framesWritten - delay), std::memory_order_relaxed);
+        }
+    }
+    snd_pcm_drop(m_pcm);
+}
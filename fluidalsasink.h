@@ -0,0 +1,89 @@
+/*
+    Drumstick RT (realtime MIDI In/Out) FluidLite Backend
+    Copyright (C) 2022, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FLUIDALSASINK_H_
+#define FLUIDALSASINK_H_
+
+#include <QThread>
+#include <QSemaphore>
+#include <QString>
+#include <atomic>
+#include <vector>
+#include <alsa/asoundlib.h>
+
+#include "fluidsampleconvert.h"
+
+class FluidRenderer;
+
+/**
+ * Plays the renderer through an ALSA PCM device opened directly, without
+ * Qt Multimedia, with the given period size and count. The thread renders
+ * straight into the mmap area of the device, so there is no intermediate
+ * buffer or thread hop; xruns are counted and reported by the
+ * underrunDetected() signal, and the stream recovers by itself.
+ */
+class FluidAlsaSink : public QThread
+{
+    Q_OBJECT
+
+public:
+    explicit FluidAlsaSink(FluidRenderer *renderer, QObject *parent = nullptr);
+    ~FluidAlsaSink();
+
+    bool open(const QString &device, int sampleRate, int channels, int periodFrames, int periods);
+    void close();
+    void stop();
+    void setSuspended(bool suspended);
+    int sampleRate() const;
+    int periodFrames() const;
+    int periods() const;
+    int bufferTime() const;
+    FluidSampleConverter::Format sampleFormat() const;
+    qint64 processedUSecs() const;
+    quint64 xruns() const;
+    QString errorString() const;
+
+signals:
+    void underrunDetected();
+
+protected:
+    void run() override;
+
+private:
+    void fill(char *dest, int frames);
+    void recover(int err);
+
+    FluidRenderer *m_renderer;
+    snd_pcm_t *m_pcm;
+    QString m_errorString;
+    int m_sampleRate;
+    int m_frameBytes;
+    snd_pcm_uframes_t m_periodFrames;
+    unsigned int m_periods;
+    snd_pcm_uframes_t m_bufferFrames;
+    FluidSampleConverter::Format m_sampleFormat;
+    std::vector<char> m_carry; // the rest of a block rendered across the end of the mmap area
+    int m_carryFrames;
+    qint64 m_framesWritten;
+    std::atomic<qint64> m_framesPlayed;
+    std::atomic<quint64> m_xruns;
+    std::atomic<bool> m_suspended;
+    QSemaphore m_resumed;
+};
+
+#endif /*FLUIDALSASINK_H_*/
@@ -0,0 +1,153 @@
+/*
+    Drumstick RT (realtime MIDI In/Out) FluidLite Backend
+    Copyright (C) 2022, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cstring>
+#include <limits>
+
+#include <QtEndian>
+
+#include "fluidaudiofile.h"
+
+const int FluidAudioFileWriter::DEFAULT_BUFFER_FRAMES = 65536;
+
+static const int WAV_HEADER_SIZE = 44;
+static const quint16 WAVE_FORMAT_IEEE_FLOAT = 3;
+
+FluidAudioFileWriter::FluidAudioFileWriter(int bufferFrames):
+    m_format(Wav),
+    m_sampleRate(0),
+    m_channels(0),
+    m_framesWritten(0),
+    m_bufferFrames(qMax(1, bufferFrames)),
+    m_used(0)
+{
+    //qDebug() << Q_FUNC_INFO;
+}
+
+FluidAudioFileWriter::~FluidAudioFileWriter()
+{
+    close();
+}
+
+bool FluidAudioFileWriter::open(const QString &fileName, Format format, int sampleRate, int channels)
+{
+    //qDebug() << Q_FUNC_INFO << fileName << format << sampleRate << channels;
+    close();
+    m_errorString.clear();
+    if (channels <= 0) {
+        m_errorString = QString("Invalid number of channels for %1: %2").arg(fileName).arg(channels);
+        return false;
+    }
+    m_format = format;
+    m_sampleRate = sampleRate;
+    m_channels = channels;
+    m_framesWritten = 0;
+    m_used = 0;
+    m_buffer.resize(static_cast<size_t>(m_bufferFrames) * channels);
+    m_file.setFileName(fileName);
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Unbuffered)) {
+        return false;
+    }
+    /* a placeholder header, rewritten with the final sizes on close() */
+    return (m_format == Raw) || writeHeader();
+}
+
+bool FluidAudioFileWriter::write(const float *frames, int count)
+{
+    size_t samples = static_cast<size_t>(count) * m_channels;
+    while (samples > 0) {
+        const size_t chunk = qMin(samples, m_buffer.size() - m_used);
+        std::memcpy(m_buffer.data() + m_used, frames, chunk * sizeof(float));
+        m_used += chunk;
+        frames += chunk;
+        samples -= chunk;
+        if (m_used == m_buffer.size() && !flush()) {
+            return false;
+        }
+    }
+    m_framesWritten += count;
+    return true;
+}
+
+bool FluidAudioFileWriter::flush()
+{
+    if (m_used == 0) {
+        return true;
+    }
+#if Q_BYTE_ORDER == Q_BIG_ENDIAN
+    for (size_t i = 0; i < m_used; ++i) {
+        quint32 word;
+        std::memcpy(&word, &m_buffer[i], sizeof(word));
+        word = qToLittleEndian(word);
+        std::memcpy(&m_buffer[i], &word, sizeof(word));
+    }
+#endif
+    const qint64 bytes = static_cast<qint64>(m_used * sizeof(float));
+    const bool ok = m_file.write(reinterpret_cast<const char *>(m_buffer.data()), bytes) == bytes;
+    m_used = 0;
+    return ok;
+}
+
+bool FluidAudioFileWriter::writeHeader()
+{
+    const qint64 dataBytes = qMin<qint64>(m_framesWritten * m_channels * sizeof(float),
+                                          std::numeric_limits<quint32>::max() - WAV_HEADER_SIZE);
+    const quint16 blockAlign = static_cast<quint16>(m_channels * sizeof(float));
+    uchar header[WAV_HEADER_SIZE];
+    std::memcpy(header, "RIFF", 4);
+    qToLittleEndian<quint32>(static_cast<quint32>(dataBytes + WAV_HEADER_SIZE - 8), header + 4);
+    std::memcpy(header + 8, "WAVEfmt ", 8);
+    qToLittleEndian<quint32>(16, header + 16);
+    qToLittleEndian<quint16>(WAVE_FORMAT_IEEE_FLOAT, header + 20);
+    qToLittleEndian<quint16>(static_cast<quint16>(m_channels), header + 22);
+    qToLittleEndian<quint32>(static_cast<quint32>(m_sampleRate), header + 24);
+    qToLittleEndian<quint32>(static_cast<quint32>(m_sampleRate) * blockAlign, header + 28);
+    qToLittleEndian<quint16>(blockAlign, header + 32);
+    qToLittleEndian<quint16>(32, header + 34);
+    std::memcpy(header + 36, "data", 4);
+    qToLittleEndian<quint32>(static_cast<quint32>(dataBytes), header + 40);
+    return m_file.write(reinterpret_cast<const char *>(header), WAV_HEADER_SIZE) == WAV_HEADER_SIZE;
+}
+
+bool FluidAudioFileWriter::close()
+{
+    if (!m_file.isOpen()) {
+        return true;
+    }
+    bool ok = flush();
+    if (m_format == Wav) {
+        ok = m_file.seek(0) && writeHeader() && ok;
+    }
+    m_file.close();
+    return ok;
+}
+
+bool FluidAudioFileWriter::isOpen() const
+{
+    return m_file.isOpen();
+}
+
+qint64 FluidAudioFileWriter::framesWritten() const
+{
+    return m_framesWritten;
+}
+
+QString FluidAudioFileWriter::errorString() const
+{
+    return m_errorString.isEmpty() ? m_file.errorString() : m_errorString;
+}
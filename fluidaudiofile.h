@@ -0,0 +1,66 @@
+/*
+    Drumstick RT (realtime MIDI In/Out) FluidLite Backend
+    Copyright (C) 2022, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FLUIDAUDIOFILE_H_
+#define FLUIDAUDIOFILE_H_
+
+#include <QFile>
+#include <QString>
+#include <vector>
+
+/**
+ * Writes interleaved 32 bit float frames to a WAV (IEEE float) or a raw
+ * little endian PCM file, collecting them in a large buffer to keep the
+ * number of write calls low.
+ */
+class FluidAudioFileWriter
+{
+public:
+    enum Format {
+        Wav,
+        Raw
+    };
+
+    explicit FluidAudioFileWriter(int bufferFrames = DEFAULT_BUFFER_FRAMES);
+    ~FluidAudioFileWriter();
+
+    bool open(const QString &fileName, Format format, int sampleRate, int channels);
+    bool write(const float *frames, int count);
+    bool close();
+    bool isOpen() const;
+    qint64 framesWritten() const;
+    QString errorString() const;
+
+    static const int DEFAULT_BUFFER_FRAMES;
+
+private:
+    bool flush();
+    bool writeHeader();
+
+    QFile m_file;
+    QString m_errorString;
+    Format m_format;
+    int m_sampleRate;
+    int m_channels;
+    qint64 m_framesWritten;
+    int m_bufferFrames;
+    std::vector<float> m_buffer; // m_bufferFrames frames of m_channels samples
+    size_t m_used;
+};
+
+#endif /*FLUIDAUDIOFILE_H_*/
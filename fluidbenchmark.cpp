@@ -0,0 +1,251 @@
+/*
+    Drumstick RT (realtime MIDI In/Out) FluidLite Backend
+    Copyright (C) 2022, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @file fluidbenchmark.cpp
+ * Headless throughput benchmark of FluidRenderer::readData().
+ *
+ * The workload file has one event per line: "<milliseconds> <command> <args>",
+ * where command is one of "on chan note vel", "off chan note", "cc chan ctl val",
+ * "prog chan program" or "bend chan value". Lines starting with '#' are ignored.
+ * Without a workload file, a dense pattern of overlapping chords is played.
+ */
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QStringList>
+#include <QTextStream>
+#include <QVector>
+
+#include <algorithm>
+#include <vector>
+
+#include "fluiddefaults.h"
+#include "fluidrenderer.h"
+
+struct WorkloadEvent
+{
+    double msecs;
+    FluidMidiEvent event;
+};
+
+static QVector<WorkloadEvent> defaultWorkload(double seconds)
+{
+    QVector<WorkloadEvent> workload;
+    const int CHORD[] = { 0, 4, 7, 12, 16, 19, 24, 28 };
+    for (double t = 0; t < seconds * 1000.0; t += 50.0) {
+        const int step = static_cast<int>(t / 50.0);
+        for (int chan = 0; chan < 16; ++chan) {
+            if (chan == 9) {
+                continue;
+            }
+            for (int note : CHORD) {
+                WorkloadEvent we;
+                we.msecs = t;
+                we.event.type = FluidMidiEvent::NoteOn;
+                we.event.chan = static_cast<quint8>(chan);
+                we.event.data1 = static_cast<quint8>(36 + (step + chan * 3 + note) % 60);
+                we.event.reserved = 0;
+                we.event.value = 64 + (step % 48);
+                we.event.nsecs = 0;
+                workload.append(we);
+            }
+        }
+    }
+    return workload;
+}
+
+static bool readWorkload(const QString &fileName, QVector<WorkloadEvent> &workload)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        return false;
+    }
+    QTextStream stream(&file);
+    while (!stream.atEnd()) {
+        const QString line = stream.readLine().trimmed();
+        if (line.isEmpty() || line.startsWith('#')) {
+            continue;
+        }
+        const QStringList f = line.simplified().split(' ');
+        if (f.size() < 3) {
+            continue;
+        }
+        WorkloadEvent we;
+        we.msecs = f[0].toDouble();
+        we.event.chan = static_cast<quint8>(f[2].toInt());
+        we.event.data1 = 0;
+        we.event.reserved = 0;
+        we.event.value = 0;
+        we.event.nsecs = 0;
+        if (f[1] == "on" && f.size() > 4) {
+            we.event.type = FluidMidiEvent::NoteOn;
+            we.event.data1 = static_cast<quint8>(f[3].toInt());
+            we.event.value = f[4].toInt();
+        } else if (f[1] == "off" && f.size() > 3) {
+            we.event.type = FluidMidiEvent::NoteOff;
+            we.event.data1 = static_cast<quint8>(f[3].toInt());
+        } else if (f[1] == "cc" && f.size() > 4) {
+            we.event.type = FluidMidiEvent::Controller;
+            we.event.data1 = static_cast<quint8>(f[3].toInt());
+            we.event.value = f[4].toInt();
+        } else if (f[1] == "prog" && f.size() > 3) {
+            we.event.type = FluidMidiEvent::Program;
+            we.event.value = f[3].toInt();
+        } else if (f[1] == "bend" && f.size() > 3) {
+            we.event.type = FluidMidiEvent::PitchBend;
+            we.event.value = f[3].toInt();
+        } else {
+            continue;
+        }
+        workload.append(we);
+    }
+    std::stable_sort(workload.begin(), workload.end(),
+                     [](const WorkloadEvent &a, const WorkloadEvent &b) { return a.msecs < b.msecs; });
+    return true;
+}
+
+static QList<int> intList(const QString &text)
+{
+    QList<int> result;
+    foreach(const QString &item, text.split(',')) {
+        if (!item.trimmed().isEmpty()) {
+            result.append(item.toInt());
+        }
+    }
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("fluidbenchmark");
+    QCoreApplication::setApplicationVersion(QT_STRINGIFY(VERSION));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("FluidLite renderer throughput benchmark");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.addPositionalArgument("soundfont", "SoundFont file (.sf2/.sf3)");
+    QCommandLineOption workloadOption("workload", "Scripted note workload file.", "file");
+    QCommandLineOption polyphonyOption("polyphony", "Comma separated polyphony values.", "list",
+        QString("%1,%2,%3").arg(FluidDefaults::DEFAULT_POLYPHONY)
+                           .arg(FluidDefaults::DEFAULT_POLYPHONY * 2)
+                           .arg(FluidDefaults::DEFAULT_POLYPHONY * 4));
+    QCommandLineOption framesOption("frames", "Comma separated rendering block sizes.", "list",
+        QString("%1,%2,%3").arg(FluidDefaults::DEFAULT_RENDERING_FRAMES)
+                           .arg(FluidDefaults::DEFAULT_RENDERING_FRAMES * 4)
+                           .arg(FluidDefaults::DEFAULT_RENDERING_FRAMES * 16));
+    QCommandLineOption ratesOption("rates", "Comma separated sample rates.", "list", "44100,48000");
+    QCommandLineOption durationOption("duration", "Rendered audio seconds per run.", "seconds", "10");
+    QCommandLineOption partitionsOption("partitions", "Comma separated numbers of channel partitions.", "list", "1");
+    QCommandLineOption bufferOption("buffer", "Bytes requested on each readData() call.", "bytes", "16384");
+    parser.addOption(workloadOption);
+    parser.addOption(polyphonyOption);
+    parser.addOption(framesOption);
+    parser.addOption(ratesOption);
+    parser.addOption(durationOption);
+    parser.addOption(partitionsOption);
+    parser.addOption(bufferOption);
+    parser.process(app);
+
+    if (parser.positionalArguments().isEmpty()) {
+        parser.showHelp(1);
+    }
+    const QString soundFont = parser.positionalArguments().first();
+    const double duration = parser.value(durationOption).toDouble();
+    const qint64 requestBytes = parser.value(bufferOption).toLongLong();
+
+    QVector<WorkloadEvent> workload;
+    if (parser.isSet(workloadOption)) {
+        if (!readWorkload(parser.value(workloadOption), workload)) {
+            qCritical("Cannot read the workload file %s", qPrintable(parser.value(workloadOption)));
+            return 1;
+        }
+    } else {
+        workload = defaultWorkload(duration);
+    }
+
+    QTextStream out(stdout);
+    out << "partitions\tpolyphony\tframes\trate\treverb\tchorus\tns/frame\trt-factor\tpeak-voices\n";
+    foreach(int partitions, intList(parser.value(partitionsOption))) {
+        foreach(int rate, intList(parser.value(ratesOption))) {
+            foreach(int frames, intList(parser.value(framesOption))) {
+                foreach(int polyphony, intList(parser.value(polyphonyOption))) {
+                    for (int fx = 0; fx < 4; ++fx) {
+                        const int reverb = (fx & 1) ? 1 : 0;
+                        const int chorus = (fx & 2) ? 1 : 0;
+                        FluidRenderer renderer;
+                        renderer.setSampleRate(rate);
+                        renderer.setRenderingFrames(frames);
+                        renderer.setPolyphony(polyphony);
+                        renderer.setReverb(reverb);
+                        renderer.setChorus(chorus);
+                        renderer.setPartitions(partitions);
+                        renderer.setSoundFont(soundFont);
+                        renderer.setOffline(true);
+                        renderer.start();
+                        if (!renderer.getStatus()) {
+                            qCritical("Cannot initialize FluidLite: %s",
+                                      qPrintable(renderer.getDiagnostics().join(QChar::LineFeed)));
+                            return 1;
+                        }
+
+                        const qint64 bytesPerFrame = FluidDefaults::DEFAULT_FRAME_CHANNELS * sizeof(float);
+                        const qint64 totalFrames = static_cast<qint64>(duration * rate);
+                        std::vector<char> buffer(qMax(requestBytes, frames * bytesPerFrame));
+                        QElapsedTimer timer;
+                        qint64 elapsed = 0;
+                        qint64 rendered = 0;
+                        int next = 0;
+                        while (rendered < totalFrames) {
+                            /* queue the events due in the next request, outside of the measurement */
+                            const qint64 horizon = rendered + static_cast<qint64>(buffer.size()) / bytesPerFrame;
+                            while (next < workload.size()) {
+                                FluidMidiEvent ev = workload[next].event;
+                                ev.frame = static_cast<quint64>(workload[next].msecs * rate / 1000.0);
+                                if (static_cast<qint64>(ev.frame) >= horizon || !renderer.postEvent(ev)) {
+                                    break;
+                                }
+                                ++next;
+                            }
+                            timer.start();
+                            const qint64 bytes = renderer.read(buffer.data(), static_cast<qint64>(buffer.size()));
+                            elapsed += timer.nsecsElapsed();
+                            rendered += bytes / bytesPerFrame;
+                        }
+                        const int peakVoices = renderer.stats().peakVoices();
+                        renderer.stop();
+
+                        const double nsPerFrame = static_cast<double>(elapsed) / rendered;
+                        const double rtFactor = (rendered * 1e9 / rate) / elapsed;
+                        out << partitions << '\t' << polyphony << '\t' << frames << '\t' << rate << '\t'
+                            << reverb << '\t' << chorus << '\t'
+                            << QString::number(nsPerFrame, 'f', 1) << '\t'
+                            << QString::number(rtFactor, 'f', 2) << '\t'
+                            << peakVoices << '\n';
+                        out.flush();
+                    }
+                }
+            }
+        }
+    }
+    return 0;
+}
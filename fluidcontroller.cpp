@@ -22,39 +22,23 @@
 #include <QFileInfo>
 #include <QStandardPaths>
 
+#if defined(FLUID_ALSA)
+#include "fluidalsasink.h"
+#endif
+#if defined(FLUID_SHM)
+#include "fluidshmsink.h"
+#endif
 #include "fluidcontroller.h"
 #include "fluidrenderer.h"
 
-const QString FluidController::QSTR_FLUIDLITE = QStringLiteral("FluidLite");
-const QString FluidController::QSTR_PREFERENCES = FluidController::QSTR_FLUIDLITE;
-const QString FluidController::QSTR_INSTRUMENTSDEFINITION = QStringLiteral("InstrumentsDefinition");
-const QString FluidController::QSTR_DATADIR = QStringLiteral("soundfonts");
-const QString FluidController::QSTR_DATADIR2 = QStringLiteral("sounds/sf2");
-const QString FluidController::QSTR_SOUNDFONT = QStringLiteral("default.sf2");
-const QString FluidController::QSTR_AUDIODEV = QStringLiteral("AudioDevice");
-
-const QString FluidController::QSTR_BUFFERTIME = QStringLiteral("BufferTime");
-const QString FluidController::QSTR_SAMPLERATE = QStringLiteral("SampleRate");
-const QString FluidController::QSTR_CHORUS = QStringLiteral("Chorus");
-const QString FluidController::QSTR_REVERB = QStringLiteral("Reverb");
-const QString FluidController::QSTR_GAIN = QStringLiteral("Gain");
-const QString FluidController::QSTR_POLYPHONY = QStringLiteral("Polyphony");
-
-const QString FluidController::DEFAULT_AUDIODEV = QStringLiteral("default");
-const int FluidController::DEFAULT_BUFFERTIME = 100;
-const int FluidController::DEFAULT_CHORUS = 0;
-const int FluidController::DEFAULT_REVERB = 1;
-const double FluidController::DEFAULT_GAIN = 1.0;
-const int FluidController::DEFAULT_POLYPHONY = 256;
-const int FluidController::DEFAULT_SAMPLERATE = 44100;
-const int FluidController::DEFAULT_RENDERING_FRAMES = 64;
-const int FluidController::DEFAULT_FRAME_CHANNELS = 2;
-
 FluidController::FluidController(int bufTime, QObject *parent) 
     : QObject(parent),
       m_renderer(nullptr),
       m_requestedBufferTime(bufTime),
+      m_bufferTime(bufTime),
       m_running(false),
+      m_sinkSerial(0),
+      m_sinkStartFrame(0),
       m_audioOutput(nullptr)
 {
     //qDebug() << Q_FUNC_INFO;
@@ -63,15 +47,56 @@ FluidController::FluidController(int bufTime, QObject *parent)
       if (m_running) {
           if (m_renderer->lastBufferSize() == 0) {
               emit stallDetected();
+              if (m_adaptiveBuffer) {
+                  adaptBufferTime(true);
+              }
           }
           m_renderer->resetLastBufferSize();
+          reportGovernor();
+          checkIdle();
       }
   });
+    connect(m_renderer, &FluidRenderer::wakeRequested, this, &FluidController::resumeAudio, Qt::QueuedConnection);
+    connect(&m_latencyTimer, &QTimer::timeout, this, [=]{
+#if defined(FLUID_ALSA)
+        if (m_running && m_alsaSink != nullptr) {
+            const qint64 usecs = m_alsaSink->processedUSecs();
+            m_renderer->updateOutputLatency(m_sinkStartFrame + static_cast<quint64>(usecs * m_renderer->sampleRate() / 1000000));
+            return;
+        }
+#endif
+#if defined(FLUID_SHM)
+        if (m_running && m_shmSink != nullptr) {
+            const qint64 usecs = m_shmSink->processedUSecs();
+            m_renderer->updateOutputLatency(m_sinkStartFrame + static_cast<quint64>(usecs * m_renderer->sampleRate() / 1000000));
+            return;
+        }
+#endif
+        if (m_running && m_audioOutput != nullptr) {
+            /* processed by the sink, less what is still waiting in its buffer */
+            const qint64 bufferedBytes = m_audioOutput->bufferSize() - m_audioOutput->bytesFree();
+            const qint64 usecs = qMax<qint64>(0, m_audioOutput->processedUSecs() -
+                                                 m_format.durationForBytes(static_cast<qint32>(qMax<qint64>(0, bufferedBytes))));
+            m_renderer->updateOutputLatency(m_sinkStartFrame + static_cast<quint64>(usecs * m_renderer->sampleRate() / 1000000));
+        }
+    });
+    m_shrinkTimer.setInterval(ADAPTIVE_SHRINK_PERIOD);
+    connect(&m_shrinkTimer, &QTimer::timeout, this, [=]{
+        if (m_running && m_adaptiveBuffer) {
+            adaptBufferTime(false);
+        }
+    });
 }
 
 FluidController::~FluidController()
 {
     //qDebug() << Q_FUNC_INFO;
+#if defined(FLUID_ALSA)
+    closeAlsa();
+#endif
+#if defined(FLUID_SHM)
+    closeShm();
+#endif
     uninitialize();
     delete m_renderer;
     delete m_audioOutput;
@@ -81,37 +106,451 @@ void
 FluidController::initialize()
 {
     //qDebug() << Q_FUNC_INFO;
-    m_renderer->initialize();
+    initAudioDevices();
+#if defined(FLUID_ALSA)
+    if (alsaBackend()) {
+        /* the device is opened first, the synth follows its rate */
+        openAlsa();
+    }
+#endif
+    m_renderer->setOutputRate(deviceRate());
+    m_renderer->setSoundFont(m_soundFont);
+    resetBufferTime();
+    /* the render thread keeps half of the buffer time pre-rendered */
+    m_renderer->setRenderThread(m_renderThread, m_bufferTime / 2, bufferTimeLimit() / 2);
     m_renderer->start();
     m_format = m_renderer->format();
-    initAudioDevices();
+    startAudio();
+}
+
+/**
+ * Applies new settings changing only what is needed: synthesis parameters
+ * are applied live, a different SoundFont is loaded in the background, and
+ * a different audio device or buffer time only rebuilds the audio sink.
+ * The synth is rebuilt only for a new sample rate, a polyphony above the
+ * initial one, or switching the render thread.
+ */
+void
+FluidController::reconfigure(QSettings *settings)
+{
+    //qDebug() << Q_FUNC_INFO;
+    if (m_renderer->stopped()) {
+        readSettings(settings);
+        initialize();
+        return;
+    }
+    const QString audioDeviceName = m_audioDeviceName;
+    const QString audioBackend = m_audioBackend;
+    const QString alsaDevice = m_alsaDevice;
+    const int periodFrames = m_periodFrames;
+    const int periods = m_periods;
+    const QString shmName = m_shmName;
+    const int bufferTime = m_requestedBufferTime;
+    const bool adaptiveBuffer = m_adaptiveBuffer;
+    const int minBufferTime = m_minBufferTime;
+    const int maxBufferTime = m_maxBufferTime;
+    const bool renderThread = m_renderThread;
+    const QString soundFont = m_soundFont;
+    const bool restart = readSettings(settings);
+    if (restart || renderThread != m_renderThread || audioBackend != m_audioBackend) {
+        stop();
+        initialize();
+        return;
+    }
+    if (soundFont != m_soundFont) {
+        m_renderer->setSoundFont(m_soundFont);
+    }
+    if (audioDeviceName != m_audioDeviceName || bufferTime != m_requestedBufferTime ||
+        adaptiveBuffer != m_adaptiveBuffer || minBufferTime != m_minBufferTime || maxBufferTime != m_maxBufferTime ||
+        alsaDevice != m_alsaDevice || periodFrames != m_periodFrames || periods != m_periods || shmName != m_shmName) {
+        resetBufferTime();
+        if (m_renderThread && bufferTimeLimit() / 2 > m_renderer->maxRingTime()) {
+            /* the render ring is too small for the new buffer time bounds */
+            stop();
+            initialize();
+            return;
+        }
+        stopAudio();
+        initAudioDevices();
+#if defined(FLUID_ALSA)
+        if (alsaBackend()) {
+            /* the rate accepted by the new device is only known once it is open */
+            openAlsa();
+        }
+#endif
+        if (deviceRate() != m_renderer->outputRate()) {
+            /* the synth follows the native rate of the new device */
+            stop();
+            initialize();
+            return;
+        }
+        startAudio();
+    }
+}
+
+void
+FluidController::startAudio()
+{
+    //qDebug() << Q_FUNC_INFO;
+    m_renderer->setRingTime(m_bufferTime / 2);
+#if defined(FLUID_ALSA)
+    if (alsaBackend()) {
+        startAlsa();
+        return;
+    }
+#endif
+#if defined(FLUID_SHM)
+    if (shmBackend()) {
+        startShm();
+        return;
+    }
+#endif
     initAudio();
-    auto bufferBytes = m_format.bytesForDuration(m_requestedBufferTime * 1000);
+    if (m_audioOutput == nullptr) {
+        return;
+    }
+    auto bufferBytes = m_format.bytesForDuration(m_bufferTime * 1000);
 //    qDebug() << Q_FUNC_INFO
 //             << "Requested buffer size:" << bufferBytes << "bytes,"
-//             << m_requestedBufferTime << "milliseconds";
+//             << m_bufferTime << "milliseconds";
     m_audioOutput->setBufferSize(bufferBytes);
+    /* the new sink starts counting its processed time from here */
+    m_sinkStartFrame = m_renderer->deliveredFrames();
     m_audioOutput->start(m_renderer);
     auto bufferTime = m_format.durationForBytes(m_audioOutput->bufferSize()) / 1000;
 //    qDebug() << Q_FUNC_INFO
 //             << "Applied Audio Output buffer size:" << m_audioOutput->bufferSize() << "bytes,"
 //             << bufferTime << "milliseconds";
+    m_idleClock.invalidate();
+    m_renderer->setSuspended(false);
+    watchAudio(bufferTime);
+}
+
+/* the stall, latency and adaptive timers start once the sink plays steadily */
+void
+FluidController::watchAudio(int bufferTime)
+{
+    const quint32 serial = ++m_sinkSerial;
     QTimer::singleShot(bufferTime * 2, this, [=]{
+        if (serial != m_sinkSerial) {
+            /* this sink has been replaced already */
+            return;
+        }
         m_running = true;
         m_stallDetector.start(bufferTime * 4);
+        m_latencyTimer.start(LATENCY_UPDATE_PERIOD);
+        if (m_adaptiveBuffer && !m_shrinkTimer.isActive()) {
+            m_shrinkTimer.start();
+        }
      });
 }
 
+void
+FluidController::resetBufferTime()
+{
+    m_bufferTime = m_adaptiveBuffer ? m_minBufferTime : m_requestedBufferTime;
+    m_shrinkTimer.stop();
+}
+
+/**
+ * Adaptive buffer time: grows by half after an underrun or stall, and shrinks
+ * by a tenth after each ADAPTIVE_SHRINK_PERIOD without them, within the
+ * configured bounds. Only the audio sink is rebuilt.
+ */
+void
+FluidController::adaptBufferTime(bool grow)
+{
+    const int bufferTime = grow ? qMin(m_bufferTime * 3 / 2 + 1, m_maxBufferTime) :
+                                  qMax(m_bufferTime * 9 / 10, m_minBufferTime);
+    if (grow) {
+        /* a clean stretch starts again */
+        m_shrinkTimer.start();
+    }
+    if (bufferTime != m_bufferTime) {
+        //qDebug() << Q_FUNC_INFO << m_bufferTime << "->" << bufferTime << "milliseconds";
+        m_bufferTime = bufferTime;
+        /* no more adaptation until the new sink runs; it may be called from a sink signal */
+        m_running = false;
+        QTimer::singleShot(0, this, &FluidController::restartAudio);
+    }
+}
+
+/* the largest buffer time the sink may get, the render ring is sized for it */
+int
+FluidController::bufferTimeLimit() const
+{
+    return m_adaptiveBuffer ? qMax(m_maxBufferTime, m_bufferTime) : m_bufferTime;
+}
+
+/* a diagnostic line for each change of the governed polyphony, polled with the stall detector */
+void
+FluidController::reportGovernor()
+{
+    const QVariantMap governor = m_renderer->governorStatus();
+    const quint64 actions = governor["reductions"].toULongLong() + governor["restores"].toULongLong();
+    if (actions != m_governorActions) {
+        m_governorActions = actions;
+        m_renderer->appendDiagnostics(fluid_log_level::FLUID_INFO,
+            qPrintable(tr("Polyphony governor: limit of %1 voices, after %2 reductions and %3 restores")
+                       .arg(governor["polyphony"].toInt())
+                       .arg(governor["reductions"].toULongLong())
+                       .arg(governor["restores"].toULongLong())));
+    }
+}
+
+/* suspends the sink after IdleTimeout milliseconds of silence, polled with the stall detector */
+void
+FluidController::checkIdle()
+{
+    if (m_idleTimeout <= 0 || !m_renderer->idle()) {
+        m_idleClock.invalidate();
+    } else if (!m_idleClock.isValid()) {
+        m_idleClock.start();
+    } else if (m_idleClock.hasExpired(m_idleTimeout)) {
+        suspendAudio();
+    }
+}
+
+void
+FluidController::suspendAudio()
+{
+    //qDebug() << Q_FUNC_INFO;
+    m_running = false;
+    ++m_sinkSerial;
+    m_stallDetector.stop();
+    m_latencyTimer.stop();
+    m_shrinkTimer.stop();
+    m_renderer->setSuspended(true);
+#if defined(FLUID_ALSA)
+    if (m_alsaSink != nullptr) {
+        m_alsaSink->setSuspended(true);
+        return;
+    }
+#endif
+#if defined(FLUID_SHM)
+    if (m_shmSink != nullptr) {
+        m_shmSink->setSuspended(true);
+        return;
+    }
+#endif
+    if (m_audioOutput != nullptr) {
+        m_audioOutput->suspend();
+    }
+}
+
+/* the first event after suspendAudio() brings the sink back */
+void
+FluidController::resumeAudio()
+{
+    //qDebug() << Q_FUNC_INFO;
+    if (!m_renderer->suspended()) {
+        return;
+    }
+#if defined(FLUID_ALSA)
+    if (m_alsaSink != nullptr) {
+        m_idleClock.invalidate();
+        m_renderer->setSuspended(false);
+        m_alsaSink->setSuspended(false);
+        watchAudio(m_alsaSink->bufferTime());
+        return;
+    }
+#endif
+#if defined(FLUID_SHM)
+    if (m_shmSink != nullptr) {
+        m_idleClock.invalidate();
+        m_renderer->setSuspended(false);
+        m_shmSink->setSuspended(false);
+        watchAudio(m_shmSink->bufferTime());
+        return;
+    }
+#endif
+    if (m_audioOutput == nullptr) {
+        return;
+    }
+    m_idleClock.invalidate();
+    m_renderer->setSuspended(false);
+    m_audioOutput->resume();
+    watchAudio(m_format.durationForBytes(m_audioOutput->bufferSize()) / 1000);
+}
+
+/* the AudioBackend setting, when the ALSA backend is built */
+bool
+FluidController::alsaBackend() const
+{
+#if defined(FLUID_ALSA)
+    return m_audioBackend.compare(AUDIOBACKEND_ALSA, Qt::CaseInsensitive) == 0;
+#else
+    return false;
+#endif
+}
+
+#if defined(FLUID_ALSA)
+/* opens the ALSA device with the channels and the rate of the renderer */
+bool
+FluidController::openAlsa()
+{
+    //qDebug() << Q_FUNC_INFO;
+    closeAlsa();
+    m_alsaSink = new FluidAlsaSink(m_renderer);
+    connect(m_alsaSink, &FluidAlsaSink::underrunDetected, this, [=]{
+        if (m_running) {
+            emit underrunDetected();
+        }
+    });
+    if (!m_alsaSink->open(m_alsaDevice, m_renderer->configuredRate(), m_renderer->channels(), m_periodFrames, m_periods)) {
+        m_renderer->appendDiagnostics(fluid_log_level::FLUID_ERR, qPrintable(m_alsaSink->errorString()));
+        delete m_alsaSink;
+        m_alsaSink = nullptr;
+        return false;
+    }
+    m_renderer->appendDiagnostics(fluid_log_level::FLUID_INFO,
+        qPrintable(tr("ALSA device %1: %2 Hz, %3 periods of %4 frames (%5 ms)")
+                   .arg(m_alsaDevice).arg(m_alsaSink->sampleRate()).arg(m_alsaSink->periods())
+                   .arg(m_alsaSink->periodFrames()).arg(m_alsaSink->bufferTime())));
+    return true;
+}
+
+/* the sink thread renders straight into the device buffer */
+void
+FluidController::startAlsa()
+{
+    //qDebug() << Q_FUNC_INFO;
+    if (m_alsaSink == nullptr && !openAlsa()) {
+        return;
+    }
+    if (m_alsaSink->sampleRate() != m_renderer->frameRate()) {
+        /* it would play at the wrong speed and pitch */
+        m_renderer->appendDiagnostics(fluid_log_level::FLUID_ERR,
+            qPrintable(tr("ALSA device %1 runs at %2 Hz instead of %3 Hz")
+                       .arg(m_alsaDevice).arg(m_alsaSink->sampleRate()).arg(m_renderer->frameRate())));
+        closeAlsa();
+        return;
+    }
+    m_renderer->setOutputSampleFormat(m_alsaSink->sampleFormat());
+    m_sinkStartFrame = m_renderer->deliveredFrames();
+    m_alsaSink->start(QThread::TimeCriticalPriority);
+    m_idleClock.invalidate();
+    m_renderer->setSuspended(false);
+    watchAudio(m_alsaSink->bufferTime());
+}
+
+void
+FluidController::closeAlsa()
+{
+    //qDebug() << Q_FUNC_INFO;
+    delete m_alsaSink;
+    m_alsaSink = nullptr;
+}
+#endif
+
+/* the AudioBackend setting, when the shared memory backend is built */
+bool
+FluidController::shmBackend() const
+{
+#if defined(FLUID_SHM)
+    return m_audioBackend.compare(AUDIOBACKEND_SHM, Qt::CaseInsensitive) == 0;
+#else
+    return false;
+#endif
+}
+
+#if defined(FLUID_SHM)
+/**
+ * Publishes the rendered frames in a shared memory ring instead of playing
+ * them: the ring has the rate of the synth, float samples, and stays the
+ * buffer time ahead of the clock.
+ */
+void
+FluidController::startShm()
+{
+    //qDebug() << Q_FUNC_INFO;
+    closeShm();
+    m_shmSink = new FluidShmSink(m_renderer);
+    connect(m_shmSink, &FluidShmSink::underrunDetected, this, [=]{
+        if (m_running) {
+            emit underrunDetected();
+        }
+    });
+    if (!m_shmSink->open(m_shmName, m_renderer->frameRate(), m_renderer->channels(), m_bufferTime)) {
+        m_renderer->appendDiagnostics(fluid_log_level::FLUID_ERR, qPrintable(m_shmSink->errorString()));
+        delete m_shmSink;
+        m_shmSink = nullptr;
+        return;
+    }
+    m_renderer->appendDiagnostics(fluid_log_level::FLUID_INFO,
+        qPrintable(tr("Shared memory ring %1: %2 Hz, %3 frames, %4 ms ahead")
+                   .arg(m_shmSink->name()).arg(m_shmSink->sampleRate())
+                   .arg(m_shmSink->capacity()).arg(m_shmSink->bufferTime())));
+    m_renderer->setOutputSampleFormat(FluidSampleConverter::Float);
+    m_sinkStartFrame = m_renderer->deliveredFrames();
+    m_shmSink->start(QThread::TimeCriticalPriority);
+    m_idleClock.invalidate();
+    m_renderer->setSuspended(false);
+    watchAudio(m_shmSink->bufferTime());
+}
+
+void
+FluidController::closeShm()
+{
+    //qDebug() << Q_FUNC_INFO;
+    delete m_shmSink;
+    m_shmSink = nullptr;
+}
+#endif
+
+int
+FluidController::bufferTime() const
+{
+    return m_bufferTime;
+}
+
+/* replaces the audio sink, while the renderer keeps its state */
+void
+FluidController::restartAudio()
+{
+    //qDebug() << Q_FUNC_INFO;
+    stopAudio();
+    initAudioDevices();
+    startAudio();
+}
+
+/* closes the audio sink, while the renderer keeps its state */
+void
+FluidController::stopAudio()
+{
+    //qDebug() << Q_FUNC_INFO;
+    m_running = false;
+    m_stallDetector.stop();
+    m_latencyTimer.stop();
+    if (m_audioOutput != nullptr && m_audioOutput->state() != QAudio::StoppedState) {
+        m_audioOutput->stop();
+    }
+#if defined(FLUID_ALSA)
+    closeAlsa();
+#endif
+#if defined(FLUID_SHM)
+    closeShm();
+#endif
+}
+
 void
 FluidController::stop()
 {
     //qDebug() << Q_FUNC_INFO;
     m_running = false;
     m_stallDetector.stop();
+    m_latencyTimer.stop();
+    m_shrinkTimer.stop();
     if (m_audioOutput != nullptr && m_audioOutput->state() != QAudio::StoppedState) {
         //qDebug() << Q_FUNC_INFO << m_audioOutput->state();
         m_audioOutput->stop();
     }
+#if defined(FLUID_ALSA)
+    closeAlsa();
+#endif
+#if defined(FLUID_SHM)
+    closeShm();
+#endif
     if(m_renderer != nullptr) {
         m_renderer->stop();
     }
@@ -121,8 +560,9 @@ FluidController::stop()
 void FluidController::uninitialize()
 {
     //qDebug() << Q_FUNC_INFO;
-    m_renderer->uninitialize();
+    /* the render, partition and effects threads must not outlive the synth */
     m_renderer->stop();
+    m_renderer->uninitialize();
 }
 
 void FluidController::open()
@@ -146,13 +586,14 @@ FluidController::initAudio()
 {
     //qDebug() << Q_FUNC_INFO;
     delete m_audioOutput;
-    if (m_availableDevices.contains(m_audioDeviceName)) {
-        m_audioDevice = m_availableDevices.value(m_audioDeviceName);
-    }
-    if (!m_audioDevice.isFormatSupported(m_format)) {
+    m_audioOutput = nullptr;
+    const QAudioFormat format = negotiateFormat(m_audioDevice, m_renderer->format().sampleRate());
+    if (!format.isValid()) {
         qCritical() << Q_FUNC_INFO << "Audio format not supported" << m_format;
         return;
     }
+    m_format = format;
+    m_renderer->setOutputFormat(m_format);
 #if QT_VERSION < QT_VERSION_CHECK(6,0,0)
     m_audioOutput = new QAudioOutput(m_audioDevice, m_format);
     m_audioOutput->setCategory("MIDI Synthesizer");
@@ -167,6 +608,9 @@ FluidController::initAudio()
         //qDebug() << "Audio Output state:" << state << "error:" << m_audioOutput->error();
         if (m_running && (m_audioOutput->error() == QAudio::UnderrunError)) {
             emit underrunDetected();
+            if (m_adaptiveBuffer) {
+                adaptBufferTime(true);
+            }
         }
     });
 }
@@ -180,7 +624,7 @@ FluidController::initAudioDevices()
     auto devices = QAudioDeviceInfo::availableDevices(QAudio::AudioOutput);
     m_audioDevice = QAudioDeviceInfo::defaultOutputDevice();
     foreach(auto &dev, devices) {
-        if (dev.isFormatSupported(m_format)) {
+        if (negotiateFormat(dev, dev.preferredFormat().sampleRate()).isValid()) {
             //qDebug() << Q_FUNC_INFO << dev.deviceName();
             m_availableDevices.insert(dev.deviceName(), dev);
         }
@@ -190,15 +634,72 @@ FluidController::initAudioDevices()
     auto devices = mediaDevices.audioOutputs();
     m_audioDevice = mediaDevices.defaultAudioOutput();
     foreach(auto &dev, devices) {
-        if (dev.isFormatSupported(m_format)) {
+        if (negotiateFormat(dev, dev.preferredFormat().sampleRate()).isValid()) {
             //qDebug() << Q_FUNC_INFO << dev.description();
             m_availableDevices.insert(dev.description(), dev);
         }
     }
 #endif
+    if (m_availableDevices.contains(m_audioDeviceName)) {
+        m_audioDevice = m_availableDevices.value(m_audioDeviceName);
+    }
     //qDebug() << Q_FUNC_INFO << audioDeviceName();
 }
 
+/* the native sample rate of the selected device, or zero if unknown */
+int
+FluidController::deviceRate() const
+{
+#if defined(FLUID_ALSA)
+    if (alsaBackend()) {
+        return m_alsaSink != nullptr ? m_alsaSink->sampleRate() : 0;
+    }
+#endif
+    if (shmBackend()) {
+        /* the ring takes the rate of the synth */
+        return 0;
+    }
+    const int sampleRate = m_audioDevice.preferredFormat().sampleRate();
+    return sampleRate > 0 ? sampleRate : 0;
+}
+
+/**
+ * Returns the format for the device, with the given sample rate and the
+ * renderer's channels, or an invalid format. The device's preferred sample format
+ * comes first, avoiding a conversion in the system mixer, then float and
+ * the integer formats.
+ */
+#if QT_VERSION < QT_VERSION_CHECK(6,0,0)
+QAudioFormat
+FluidController::negotiateFormat(const QAudioDeviceInfo &device, int sampleRate) const
+#else
+QAudioFormat
+FluidController::negotiateFormat(const QAudioDevice &device, int sampleRate) const
+#endif
+{
+    QList<FluidSampleConverter::Format> candidates;
+    FluidSampleConverter::Format preferred;
+    if (FluidRenderer::sampleFormat(device.preferredFormat(), preferred)) {
+        candidates << preferred;
+    }
+    candidates << FluidSampleConverter::Float << FluidSampleConverter::Int32;
+#if QT_VERSION < QT_VERSION_CHECK(6,0,0)
+    candidates << FluidSampleConverter::Int24;
+#endif
+    candidates << FluidSampleConverter::Int16;
+    QAudioFormat format = m_renderer->format();
+    if (sampleRate > 0) {
+        format.setSampleRate(sampleRate);
+    }
+    foreach(auto sampleFormat, candidates) {
+        FluidRenderer::setSampleFormat(format, sampleFormat);
+        if (device.isFormatSupported(format)) {
+            return format;
+        }
+    }
+    return QAudioFormat();
+}
+
 #if QT_VERSION < QT_VERSION_CHECK(6,0,0)
 const QAudioDeviceInfo&
 FluidController::audioDevice() const
@@ -236,7 +737,8 @@ FluidController::availableAudioDevices() const
     return m_availableDevices.keys();
 }
 
-void FluidController::readSettings(QSettings *settings)
+/* returns true when the renderer needs a restart to apply the settings */
+bool FluidController::readSettings(QSettings *settings)
 {
     //qDebug() << Q_FUNC_INFO;
     QDir dir;
@@ -255,14 +757,22 @@ void FluidController::readSettings(QSettings *settings)
         m_defSoundFont = sf2.absoluteFilePath();
     }
     settings->beginGroup(QSTR_PREFERENCES);
-    m_renderer->m_soundFont = settings->value(QSTR_INSTRUMENTSDEFINITION, m_defSoundFont).toString();
+    m_soundFont = settings->value(QSTR_INSTRUMENTSDEFINITION, m_defSoundFont).toString();
     m_requestedBufferTime = settings->value(QSTR_BUFFERTIME, DEFAULT_BUFFERTIME).toInt();
-    m_renderer->m_chorus = settings->value(QSTR_CHORUS, DEFAULT_CHORUS).toInt();
-    m_renderer->m_reverb = settings->value(QSTR_REVERB, DEFAULT_REVERB).toInt();
-    m_renderer->m_gain = settings->value(QSTR_GAIN, DEFAULT_GAIN).toDouble();
-    m_renderer->m_polyphony = settings->value(QSTR_POLYPHONY, DEFAULT_POLYPHONY).toInt();
+    m_adaptiveBuffer = settings->value(QSTR_ADAPTIVEBUFFER, DEFAULT_ADAPTIVEBUFFER).toBool();
+    m_minBufferTime = settings->value(QSTR_MINBUFFERTIME, DEFAULT_MINBUFFERTIME).toInt();
+    m_maxBufferTime = qMax(m_minBufferTime, settings->value(QSTR_MAXBUFFERTIME, DEFAULT_MAXBUFFERTIME).toInt());
+    m_renderThread = settings->value(QSTR_RENDERTHREAD, DEFAULT_RENDERTHREAD).toBool();
+    m_idleTimeout = settings->value(QSTR_IDLETIMEOUT, DEFAULT_IDLETIMEOUT).toInt();
     m_audioDeviceName = settings->value(QSTR_AUDIODEV, DEFAULT_AUDIODEV).toString();
+    m_audioBackend = settings->value(QSTR_AUDIOBACKEND, DEFAULT_AUDIOBACKEND).toString();
+    m_alsaDevice = settings->value(QSTR_ALSADEVICE, DEFAULT_ALSADEVICE).toString();
+    m_periodFrames = qMax(16, settings->value(QSTR_PERIODFRAMES, DEFAULT_PERIODFRAMES).toInt());
+    m_periods = qMax(2, settings->value(QSTR_PERIODS, DEFAULT_PERIODS).toInt());
+    m_shmName = settings->value(QSTR_SHMNAME, DEFAULT_SHMNAME).toString();
     settings->endGroup();
+    const bool restart = m_renderer->readSettings(settings);
     //qputenv("PULSE_LATENCY_MSEC", QByteArray::number( m_requestedBufferTime ) );
     //qDebug() << Q_FUNC_INFO << "$PULSE_LATENCY_MSEC=" << bufferTime;
+    return restart;
 }
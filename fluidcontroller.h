@@ -22,6 +22,7 @@
 #include <QObject>
 #include <QMap>
 #include <QTimer>
+#include <QElapsedTimer>
 #include <QScopedPointer>
 #include <QSettings>
 
@@ -33,9 +34,17 @@
 #include <QMediaDevices>
 #endif
 
+#include "fluiddefaults.h"
 #include "fluidrenderer.h"
 
-class FluidController : public QObject
+#if defined(FLUID_ALSA)
+class FluidAlsaSink;
+#endif
+#if defined(FLUID_SHM)
+class FluidShmSink;
+#endif
+
+class FluidController : public QObject, public FluidDefaults
 {
     Q_OBJECT
 public:
@@ -45,11 +54,13 @@ public:
     FluidRenderer *renderer() const;
     void stop();
     void initialize();
+    void reconfigure(QSettings *settings);
     void uninitialize();
     void open();
     void close();
     QStringList availableAudioDevices() const;
-    void readSettings(QSettings *settings);
+    int bufferTime() const;
+    bool readSettings(QSettings *settings);
 
 #if QT_VERSION < QT_VERSION_CHECK(6,0,0)
     const QAudioDeviceInfo &audioDevice() const;
@@ -59,31 +70,6 @@ public:
     void setAudioDevice(const QAudioDevice &newAudioDevice);
 #endif
 
-    static const QString QSTR_FLUIDLITE;
-    static const QString QSTR_PREFERENCES;
-    static const QString QSTR_INSTRUMENTSDEFINITION;
-    static const QString QSTR_DATADIR;
-    static const QString QSTR_DATADIR2;
-    static const QString QSTR_SOUNDFONT;
-    static const QString QSTR_AUDIODEV;
-
-    static const QString QSTR_BUFFERTIME;
-    static const QString QSTR_SAMPLERATE;
-    static const QString QSTR_CHORUS;
-    static const QString QSTR_REVERB;
-    static const QString QSTR_GAIN;
-    static const QString QSTR_POLYPHONY;
-
-    static const QString DEFAULT_AUDIODEV;
-    static const int DEFAULT_BUFFERTIME;
-    static const int DEFAULT_CHORUS;
-    static const int DEFAULT_REVERB;
-    static const double DEFAULT_GAIN;
-    static const int DEFAULT_POLYPHONY;
-    static const int DEFAULT_SAMPLERATE;
-    static const int DEFAULT_RENDERING_FRAMES;
-    static const int DEFAULT_FRAME_CHANNELS;
-
 signals:
     void finished();
     void underrunDetected();
@@ -92,13 +78,59 @@ signals:
 private:
     void initAudio();
     void initAudioDevices();
+    void startAudio();
+    void watchAudio(int bufferTime);
+    void restartAudio();
+    void stopAudio();
+    void checkIdle();
+    void suspendAudio();
+    void resumeAudio();
+    void resetBufferTime();
+    void adaptBufferTime(bool grow);
+    int bufferTimeLimit() const;
+    void reportGovernor();
+    bool alsaBackend() const;
+#if defined(FLUID_ALSA)
+    bool openAlsa();
+    void startAlsa();
+    void closeAlsa();
+#endif
+    bool shmBackend() const;
+#if defined(FLUID_SHM)
+    void startShm();
+    void closeShm();
+#endif
+#if QT_VERSION < QT_VERSION_CHECK(6,0,0)
+    QAudioFormat negotiateFormat(const QAudioDeviceInfo &device, int sampleRate) const;
+#else
+    QAudioFormat negotiateFormat(const QAudioDevice &device, int sampleRate) const;
+#endif
+    int deviceRate() const;
 
 private:
     FluidRenderer* m_renderer;
     QTimer m_stallDetector;
+    QTimer m_latencyTimer;
+    QTimer m_shrinkTimer;
     QString m_audioDeviceName { DEFAULT_AUDIODEV };
     int m_requestedBufferTime { DEFAULT_BUFFERTIME };
+    int m_bufferTime; // applied, changing in adaptive mode
+    bool m_adaptiveBuffer { DEFAULT_ADAPTIVEBUFFER };
+    int m_minBufferTime { DEFAULT_MINBUFFERTIME };
+    int m_maxBufferTime { DEFAULT_MAXBUFFERTIME };
+    bool m_renderThread { DEFAULT_RENDERTHREAD };
+    quint64 m_governorActions { 0 };
+    int m_idleTimeout { DEFAULT_IDLETIMEOUT };
+    QString m_audioBackend { DEFAULT_AUDIOBACKEND };
+    QString m_alsaDevice { DEFAULT_ALSADEVICE };
+    int m_periodFrames { DEFAULT_PERIODFRAMES };
+    int m_periods { DEFAULT_PERIODS };
+    QString m_shmName { DEFAULT_SHMNAME };
+    QElapsedTimer m_idleClock;
+    QString m_soundFont;
     bool m_running;
+    quint32 m_sinkSerial;
+    quint64 m_sinkStartFrame;
     
     QAudioFormat m_format;
 #if QT_VERSION < QT_VERSION_CHECK(6,0,0)
@@ -110,6 +142,12 @@ private:
     QMap<QString,QAudioDevice> m_availableDevices;
     QAudioDevice m_audioDevice;
 #endif
+#if defined(FLUID_ALSA)
+    FluidAlsaSink *m_alsaSink { nullptr };
+#endif
+#if defined(FLUID_SHM)
+    FluidShmSink *m_shmSink { nullptr };
+#endif
     
     QString m_defSoundFont;
 };
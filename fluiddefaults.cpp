@@ -0,0 +1,95 @@
+/*
+    Drumstick RT (realtime MIDI In/Out) FluidLite Backend
+    Copyright (C) 2022, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "fluiddefaults.h"
+
+const QString FluidDefaults::QSTR_FLUIDLITE = QStringLiteral("FluidLite");
+const QString FluidDefaults::QSTR_PREFERENCES = FluidDefaults::QSTR_FLUIDLITE;
+const QString FluidDefaults::QSTR_INSTRUMENTSDEFINITION = QStringLiteral("InstrumentsDefinition");
+const QString FluidDefaults::QSTR_DATADIR = QStringLiteral("soundfonts");
+const QString FluidDefaults::QSTR_DATADIR2 = QStringLiteral("sounds/sf2");
+const QString FluidDefaults::QSTR_SOUNDFONT = QStringLiteral("default.sf2");
+const QString FluidDefaults::QSTR_AUDIODEV = QStringLiteral("AudioDevice");
+
+const QString FluidDefaults::QSTR_BUFFERTIME = QStringLiteral("BufferTime");
+const QString FluidDefaults::QSTR_ADAPTIVEBUFFER = QStringLiteral("AdaptiveBuffer");
+const QString FluidDefaults::QSTR_MINBUFFERTIME = QStringLiteral("MinBufferTime");
+const QString FluidDefaults::QSTR_MAXBUFFERTIME = QStringLiteral("MaxBufferTime");
+const QString FluidDefaults::QSTR_RENDERTHREAD = QStringLiteral("RenderThread");
+const QString FluidDefaults::QSTR_SAMPLERATE = QStringLiteral("SampleRate");
+const QString FluidDefaults::QSTR_CHORUS = QStringLiteral("Chorus");
+const QString FluidDefaults::QSTR_REVERB = QStringLiteral("Reverb");
+const QString FluidDefaults::QSTR_GAIN = QStringLiteral("Gain");
+const QString FluidDefaults::QSTR_POLYPHONY = QStringLiteral("Polyphony");
+const QString FluidDefaults::QSTR_PARTITIONS = QStringLiteral("Partitions");
+const QString FluidDefaults::QSTR_PORTS = QStringLiteral("Ports");
+const QString FluidDefaults::QSTR_RESAMPLE = QStringLiteral("Resample");
+const QString FluidDefaults::QSTR_POLYPHONYGOVERNOR = QStringLiteral("PolyphonyGovernor");
+const QString FluidDefaults::QSTR_IDLETIMEOUT = QStringLiteral("IdleTimeout");
+const QString FluidDefaults::QSTR_STEMS = QStringLiteral("Stems");
+const QString FluidDefaults::QSTR_PIPELINEDEFFECTS = QStringLiteral("PipelinedEffects");
+const QString FluidDefaults::QSTR_AUDIOBACKEND = QStringLiteral("AudioBackend");
+const QString FluidDefaults::QSTR_ALSADEVICE = QStringLiteral("AlsaDevice");
+const QString FluidDefaults::QSTR_PERIODFRAMES = QStringLiteral("PeriodFrames");
+const QString FluidDefaults::QSTR_PERIODS = QStringLiteral("Periods");
+const QString FluidDefaults::QSTR_SHMNAME = QStringLiteral("SharedMemoryName");
+const QString FluidDefaults::AUDIOBACKEND_QT = QStringLiteral("QtMultimedia");
+const QString FluidDefaults::AUDIOBACKEND_ALSA = QStringLiteral("ALSA");
+const QString FluidDefaults::AUDIOBACKEND_SHM = QStringLiteral("SharedMemory");
+
+const QString FluidDefaults::DEFAULT_AUDIODEV = QStringLiteral("default");
+const int FluidDefaults::DEFAULT_BUFFERTIME = 100;
+const bool FluidDefaults::DEFAULT_ADAPTIVEBUFFER = false;
+const int FluidDefaults::DEFAULT_MINBUFFERTIME = 20;
+const int FluidDefaults::DEFAULT_MAXBUFFERTIME = 500;
+const bool FluidDefaults::DEFAULT_RENDERTHREAD = false;
+const int FluidDefaults::DEFAULT_CHORUS = 0;
+const int FluidDefaults::DEFAULT_REVERB = 1;
+const double FluidDefaults::DEFAULT_GAIN = 1.0;
+const int FluidDefaults::DEFAULT_POLYPHONY = 256;
+const int FluidDefaults::DEFAULT_PARTITIONS = 1;
+const int FluidDefaults::DEFAULT_PORTS = 1;
+const bool FluidDefaults::DEFAULT_RESAMPLE = false;
+const bool FluidDefaults::DEFAULT_POLYPHONYGOVERNOR = false;
+const int FluidDefaults::DEFAULT_IDLETIMEOUT = 0;
+const int FluidDefaults::DEFAULT_STEMS = 0;
+const bool FluidDefaults::DEFAULT_PIPELINEDEFFECTS = false;
+const QString FluidDefaults::DEFAULT_AUDIOBACKEND = FluidDefaults::AUDIOBACKEND_QT;
+const QString FluidDefaults::DEFAULT_ALSADEVICE = QStringLiteral("default");
+const int FluidDefaults::DEFAULT_PERIODFRAMES = 256;
+const int FluidDefaults::DEFAULT_PERIODS = 2;
+const QString FluidDefaults::DEFAULT_SHMNAME = QStringLiteral("/drumstick-rt-fluidlite");
+const int FluidDefaults::DEFAULT_SAMPLERATE = 44100;
+const int FluidDefaults::DEFAULT_RENDERING_FRAMES = 64;
+const int FluidDefaults::DEFAULT_FRAME_CHANNELS = 2;
+const int FluidDefaults::STEM_SEND_CHANNELS = 4;
+const int FluidDefaults::DEFAULT_EVENT_QUEUE_SIZE = 4096;
+const int FluidDefaults::DEFAULT_SYSEX_QUEUE_SIZE = 65536;
+const int FluidDefaults::DEFAULT_OFFLINE_FRAMES = 4096;
+const int FluidDefaults::DEFAULT_LATENCY_PROBES = 1024;
+const int FluidDefaults::DEFAULT_DIAGNOSTICS_SIZE = 256;
+const int FluidDefaults::LATENCY_UPDATE_PERIOD = 5;
+const int FluidDefaults::SOUNDFONT_RELEASE_TIME = 2000;
+const int FluidDefaults::ADAPTIVE_SHRINK_PERIOD = 30000;
+const int FluidDefaults::GOVERNOR_HIGH_LOAD = 85;
+const int FluidDefaults::GOVERNOR_LOW_LOAD = 50;
+const int FluidDefaults::GOVERNOR_MIN_POLYPHONY = 16;
+const int FluidDefaults::GOVERNOR_HOLD_TIME = 50;
+const int FluidDefaults::GOVERNOR_RESTORE_TIME = 1000;
+const float FluidDefaults::GOVERNOR_RELEASE = -7200.0f; // timecents, the shortest volume release
+const double FluidDefaults::IDLE_SILENCE_LEVEL = 1e-5;
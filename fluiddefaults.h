@@ -0,0 +1,109 @@
+/*
+    Drumstick RT (realtime MIDI In/Out) FluidLite Backend
+    Copyright (C) 2022, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FLUIDDEFAULTS_H_
+#define FLUIDDEFAULTS_H_
+
+#include <QString>
+
+/**
+ * The settings keys, their default values, and the tuning constants of the
+ * backend. They don't depend on Qt Multimedia, so the renderer core can be
+ * built without it; FluidController inherits them for the plugin code.
+ */
+class FluidDefaults
+{
+public:
+    static const QString QSTR_FLUIDLITE;
+    static const QString QSTR_PREFERENCES;
+    static const QString QSTR_INSTRUMENTSDEFINITION;
+    static const QString QSTR_DATADIR;
+    static const QString QSTR_DATADIR2;
+    static const QString QSTR_SOUNDFONT;
+    static const QString QSTR_AUDIODEV;
+
+    static const QString QSTR_BUFFERTIME;
+    static const QString QSTR_ADAPTIVEBUFFER;
+    static const QString QSTR_MINBUFFERTIME;
+    static const QString QSTR_MAXBUFFERTIME;
+    static const QString QSTR_RENDERTHREAD;
+    static const QString QSTR_SAMPLERATE;
+    static const QString QSTR_CHORUS;
+    static const QString QSTR_REVERB;
+    static const QString QSTR_GAIN;
+    static const QString QSTR_POLYPHONY;
+    static const QString QSTR_PARTITIONS;
+    static const QString QSTR_PORTS;
+    static const QString QSTR_RESAMPLE;
+    static const QString QSTR_POLYPHONYGOVERNOR;
+    static const QString QSTR_IDLETIMEOUT;
+    static const QString QSTR_STEMS;
+    static const QString QSTR_PIPELINEDEFFECTS;
+    static const QString QSTR_AUDIOBACKEND;
+    static const QString QSTR_ALSADEVICE;
+    static const QString QSTR_PERIODFRAMES;
+    static const QString QSTR_PERIODS;
+    static const QString QSTR_SHMNAME;
+    static const QString AUDIOBACKEND_QT;
+    static const QString AUDIOBACKEND_ALSA;
+    static const QString AUDIOBACKEND_SHM;
+
+    static const QString DEFAULT_AUDIODEV;
+    static const int DEFAULT_BUFFERTIME;
+    static const bool DEFAULT_ADAPTIVEBUFFER;
+    static const int DEFAULT_MINBUFFERTIME;
+    static const int DEFAULT_MAXBUFFERTIME;
+    static const bool DEFAULT_RENDERTHREAD;
+    static const int DEFAULT_CHORUS;
+    static const int DEFAULT_REVERB;
+    static const double DEFAULT_GAIN;
+    static const int DEFAULT_POLYPHONY;
+    static const int DEFAULT_PARTITIONS;
+    static const int DEFAULT_PORTS;
+    static const bool DEFAULT_RESAMPLE;
+    static const bool DEFAULT_POLYPHONYGOVERNOR;
+    static const int DEFAULT_IDLETIMEOUT;
+    static const int DEFAULT_STEMS;
+    static const bool DEFAULT_PIPELINEDEFFECTS;
+    static const QString DEFAULT_AUDIOBACKEND;
+    static const QString DEFAULT_ALSADEVICE;
+    static const int DEFAULT_PERIODFRAMES;
+    static const int DEFAULT_PERIODS;
+    static const QString DEFAULT_SHMNAME;
+    static const int DEFAULT_SAMPLERATE;
+    static const int DEFAULT_RENDERING_FRAMES;
+    static const int DEFAULT_FRAME_CHANNELS;
+    static const int STEM_SEND_CHANNELS;
+    static const int DEFAULT_EVENT_QUEUE_SIZE;
+    static const int DEFAULT_SYSEX_QUEUE_SIZE;
+    static const int DEFAULT_OFFLINE_FRAMES;
+    static const int DEFAULT_LATENCY_PROBES;
+    static const int DEFAULT_DIAGNOSTICS_SIZE;
+    static const int LATENCY_UPDATE_PERIOD;
+    static const int SOUNDFONT_RELEASE_TIME;
+    static const int ADAPTIVE_SHRINK_PERIOD;
+    static const int GOVERNOR_HIGH_LOAD;
+    static const int GOVERNOR_LOW_LOAD;
+    static const int GOVERNOR_MIN_POLYPHONY;
+    static const int GOVERNOR_HOLD_TIME;
+    static const int GOVERNOR_RESTORE_TIME;
+    static const float GOVERNOR_RELEASE;
+    static const double IDLE_SILENCE_LEVEL;
+};
+
+#endif /*FLUIDDEFAULTS_H_*/
@@ -0,0 +1,103 @@
+/*
+    Drumstick RT (realtime MIDI In/Out) FluidLite Backend
+    Copyright (C) 2022, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cstring>
+
+#include "fluiddiagnostics.h"
+
+static size_t powerOfTwo(size_t capacity)
+{
+    size_t size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    return size;
+}
+
+FluidDiagnosticsLog::FluidDiagnosticsLog(size_t capacity):
+    m_records(powerOfTwo(capacity)),
+    m_mask(m_records.size() - 1),
+    m_head(0),
+    m_first(0)
+{
+    for (Record &record : m_records) {
+        record.sequence.store(0, std::memory_order_relaxed);
+        record.level = 0;
+        record.text[0] = '\0';
+    }
+}
+
+void FluidDiagnosticsLog::append(int level, const char *message)
+{
+    const quint64 position = m_head.fetch_add(1, std::memory_order_relaxed);
+    Record &record = m_records[position & m_mask];
+    record.sequence.store(2 * position + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    record.level = level;
+    if (message == nullptr) {
+        record.text[0] = '\0';
+    } else {
+        std::strncpy(record.text, message, MESSAGE_SIZE - 1);
+        record.text[MESSAGE_SIZE - 1] = '\0';
+    }
+    record.sequence.store(2 * position + 2, std::memory_order_release);
+}
+
+/* forgets the messages appended so far, see entries() */
+void FluidDiagnosticsLog::clear()
+{
+    m_first.store(m_head.load(std::memory_order_acquire), std::memory_order_relaxed);
+}
+
+/* the retained messages, oldest first */
+QVector<FluidDiagnosticsLog::Entry> FluidDiagnosticsLog::entries() const
+{
+    QVector<Entry> result;
+    const quint64 head = m_head.load(std::memory_order_acquire);
+    quint64 first = m_first.load(std::memory_order_relaxed);
+    if (head - first > m_records.size()) {
+        first = head - m_records.size();
+    }
+    char text[MESSAGE_SIZE];
+    for (quint64 position = first; position < head; ++position) {
+        const Record &record = m_records[position & m_mask];
+        const quint64 sequence = record.sequence.load(std::memory_order_acquire);
+        if (sequence != 2 * position + 2) {
+            continue;
+        }
+        const int level = record.level;
+        std::memcpy(text, record.text, MESSAGE_SIZE);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (record.sequence.load(std::memory_order_relaxed) != sequence) {
+            continue;
+        }
+        text[MESSAGE_SIZE - 1] = '\0';
+        Entry entry;
+        entry.level = level;
+        entry.text = QString::fromUtf8(text);
+        result.append(entry);
+    }
+    return result;
+}
+
+/* messages overwritten by newer ones since the last clear() */
+quint64 FluidDiagnosticsLog::discarded() const
+{
+    const quint64 retained = m_head.load(std::memory_order_acquire) - m_first.load(std::memory_order_relaxed);
+    return retained > m_records.size() ? retained - m_records.size() : 0;
+}
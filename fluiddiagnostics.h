@@ -0,0 +1,65 @@
+/*
+    Drumstick RT (realtime MIDI In/Out) FluidLite Backend
+    Copyright (C) 2022, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FLUIDDIAGNOSTICS_H_
+#define FLUIDDIAGNOSTICS_H_
+
+#include <QtGlobal>
+#include <QString>
+#include <QVector>
+#include <atomic>
+#include <vector>
+
+/**
+ * Bounded log of diagnostic messages, keeping the most recent ones.
+ *
+ * append() may be called from any thread, including the audio thread: it
+ * copies the message into a preallocated record, without locks or memory
+ * allocation, truncated to MESSAGE_SIZE - 1 bytes. The records are turned
+ * into strings only by entries(), which skips those being overwritten.
+ */
+class FluidDiagnosticsLog
+{
+public:
+    static const int MESSAGE_SIZE = 256;
+
+    struct Entry {
+        int level;
+        QString text;
+    };
+
+    explicit FluidDiagnosticsLog(size_t capacity);
+
+    void append(int level, const char *message);
+    void clear();
+    QVector<Entry> entries() const;
+    quint64 discarded() const;
+
+private:
+    struct Record {
+        std::atomic<quint64> sequence; // odd while written, 2 * (position + 1) when complete
+        int level;
+        char text[MESSAGE_SIZE];
+    };
+    std::vector<Record> m_records;
+    quint64 m_mask;
+    std::atomic<quint64> m_head;
+    std::atomic<quint64> m_first; // position of the oldest message after clear()
+};
+
+#endif /*FLUIDDIAGNOSTICS_H_*/
@@ -0,0 +1,238 @@
+/*
+    Drumstick RT (realtime MIDI In/Out) FluidLite Backend
+    Copyright (C) 2022, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QtGlobal>
+#include <cmath>
+#include <algorithm>
+
+#include "fluideffects.h"
+
+static const double PI = 3.14159265358979323846;
+
+/* Freeverb tunings, in samples at 44100 Hz */
+static const int COMB_TUNING[FluidEffects::COMBS] = { 1116, 1188, 1277, 1356, 1422, 1491, 1557, 1617 };
+static const int ALLPASS_TUNING[FluidEffects::ALLPASSES] = { 556, 441, 341, 225 };
+static const int STEREO_SPREAD = 23;
+static const float FIXED_GAIN = 0.015f;
+static const float SCALE_WET = 3.0f;
+static const float SCALE_ROOM = 0.28f;
+static const float OFFSET_ROOM = 0.7f;
+static const float ALLPASS_FEEDBACK = 0.5f;
+
+/* the default SoundFont modulators send up to 20% of a voice to each effect */
+static const float SEND_LEVEL = 0.2f;
+
+static const double MAX_CHORUS_DEPTH = 256.0; // ms
+static const int CHORUS_MIN_DELAY = 2; // samples, for the interpolation
+
+static inline float flushDenormal(float x)
+{
+    return (x > -1e-20f && x < 1e-20f) ? 0.0f : x;
+}
+
+FluidEffects::FluidEffects():
+    m_sampleRate(0),
+    m_silenceLevel(0.0f),
+    m_quiet(true),
+    m_peak(0.0f),
+    m_holdLength(0),
+    m_hold(0),
+    m_reverb(false),
+    m_feedback(0.0f),
+    m_damp1(0.0f),
+    m_damp2(1.0f),
+    m_wet1(0.0f),
+    m_wet2(0.0f),
+    m_chorus(false),
+    m_chorusIndex(0),
+    m_chorusVoices(1),
+    m_chorusLevel(0.0f),
+    m_chorusPhase(0.0),
+    m_chorusStep(0.0),
+    m_chorusDepth(0.0f)
+{ }
+
+void FluidEffects::setup(int sampleRate, float silenceLevel)
+{
+    m_sampleRate = sampleRate;
+    m_silenceLevel = silenceLevel;
+    const double scale = sampleRate / 44100.0;
+    for (int side = 0; side < 2; ++side) {
+        const int spread = side * STEREO_SPREAD;
+        for (int i = 0; i < COMBS; ++i) {
+            m_combs[side][i].buffer.assign(qMax(1, qRound((COMB_TUNING[i] + spread) * scale)), 0.0f);
+        }
+        for (int i = 0; i < ALLPASSES; ++i) {
+            m_allpasses[side][i].buffer.assign(qMax(1, qRound((ALLPASS_TUNING[i] + spread) * scale)), 0.0f);
+        }
+    }
+    int length = 1;
+    while (length < CHORUS_MIN_DELAY + MAX_CHORUS_DEPTH * sampleRate / 1000.0 + 2) {
+        length <<= 1;
+    }
+    m_chorusLine.assign(length, 0.0f);
+    m_holdLength = qRound((COMB_TUNING[COMBS - 1] + STEREO_SPREAD) * scale) + length;
+    for (int i = 0; i < ALLPASSES; ++i) {
+        m_holdLength += qRound((ALLPASS_TUNING[i] + STEREO_SPREAD) * scale);
+    }
+    reset();
+}
+
+void FluidEffects::reset()
+{
+    clearReverb();
+    clearChorus();
+    m_quiet = true;
+    m_peak = 0.0f;
+    m_hold = 0;
+}
+
+void FluidEffects::clearReverb()
+{
+    for (int side = 0; side < 2; ++side) {
+        for (Comb &comb : m_combs[side]) {
+            std::fill(comb.buffer.begin(), comb.buffer.end(), 0.0f);
+            comb.index = 0;
+            comb.store = 0.0f;
+        }
+        for (Allpass &allpass : m_allpasses[side]) {
+            std::fill(allpass.buffer.begin(), allpass.buffer.end(), 0.0f);
+            allpass.index = 0;
+        }
+    }
+}
+
+void FluidEffects::clearChorus()
+{
+    std::fill(m_chorusLine.begin(), m_chorusLine.end(), 0.0f);
+    m_chorusIndex = 0;
+}
+
+/* the parameters of fluid_synth_set_reverb() */
+void FluidEffects::setReverb(bool enabled, double roomSize, double damping, double width, double level)
+{
+    if (enabled && !m_reverb) {
+        clearReverb();
+    }
+    m_reverb = enabled;
+    m_feedback = static_cast<float>(roomSize) * SCALE_ROOM + OFFSET_ROOM;
+    m_damp1 = static_cast<float>(damping);
+    m_damp2 = 1.0f - m_damp1;
+    const float wet = static_cast<float>(level) * SCALE_WET;
+    m_wet1 = wet * (static_cast<float>(width) / 2.0f + 0.5f);
+    m_wet2 = wet * ((1.0f - static_cast<float>(width)) / 2.0f);
+}
+
+/* the parameters of fluid_synth_set_chorus(), with a sine modulation */
+void FluidEffects::setChorus(bool enabled, int voices, double level, double speed, double depth)
+{
+    if (enabled && !m_chorus) {
+        clearChorus();
+    }
+    m_chorus = enabled && voices > 0;
+    m_chorusVoices = qBound(1, voices, MAX_CHORUS_VOICES);
+    m_chorusLevel = static_cast<float>(level);
+    m_chorusStep = m_sampleRate > 0 ? speed / m_sampleRate : 0.0;
+    m_chorusDepth = static_cast<float>(qBound(0.0, depth, MAX_CHORUS_DEPTH) * m_sampleRate / 1000.0);
+}
+
+void FluidEffects::process(const float *sends, float *output, int frames)
+{
+    if (!m_reverb && !m_chorus) {
+        m_peak = 0.0f;
+        return;
+    }
+    bool silent = true;
+    for (int i = 0; i < frames * SEND_CHANNELS && silent; ++i) {
+        silent = (sends[i] <= m_silenceLevel && sends[i] >= -m_silenceLevel);
+    }
+    if (!silent) {
+        /* the input takes a while to come out of the delay lines */
+        m_hold = m_holdLength;
+    } else if (m_hold <= 0 && m_peak <= m_silenceLevel) {
+        if (!m_quiet) {
+            reset();
+        }
+        return;
+    }
+    m_hold -= frames;
+    m_quiet = false;
+    const int chorusMask = static_cast<int>(m_chorusLine.size()) - 1;
+    const double voicePhase = 1.0 / m_chorusVoices;
+    float peak = 0.0f;
+    for (int i = 0; i < frames; ++i) {
+        const float *send = sends + i * SEND_CHANNELS;
+        float left = 0.0f, right = 0.0f;
+        if (m_reverb) {
+            const float input = (send[0] + send[1]) * SEND_LEVEL * FIXED_GAIN;
+            float out[2] = { 0.0f, 0.0f };
+            for (int side = 0; side < 2; ++side) {
+                for (Comb &comb : m_combs[side]) {
+                    const float delayed = comb.buffer[comb.index];
+                    comb.store = flushDenormal(delayed * m_damp2 + comb.store * m_damp1);
+                    comb.buffer[comb.index] = input + comb.store * m_feedback;
+                    if (++comb.index >= static_cast<int>(comb.buffer.size())) {
+                        comb.index = 0;
+                    }
+                    out[side] += delayed;
+                }
+                for (Allpass &allpass : m_allpasses[side]) {
+                    const float delayed = flushDenormal(allpass.buffer[allpass.index]);
+                    allpass.buffer[allpass.index] = out[side] + delayed * ALLPASS_FEEDBACK;
+                    out[side] = delayed - out[side];
+                    if (++allpass.index >= static_cast<int>(allpass.buffer.size())) {
+                        allpass.index = 0;
+                    }
+                }
+            }
+            left += out[0] * m_wet1 + out[1] * m_wet2;
+            right += out[1] * m_wet1 + out[0] * m_wet2;
+        }
+        if (m_chorus) {
+            m_chorusLine[m_chorusIndex] = (send[2] + send[3]) * 0.5f * SEND_LEVEL;
+            float chorus = 0.0f;
+            for (int voice = 0; voice < m_chorusVoices; ++voice) {
+                const double lfo = std::sin(2.0 * PI * (m_chorusPhase + voice * voicePhase));
+                const float delay = CHORUS_MIN_DELAY + m_chorusDepth * 0.5f * static_cast<float>(1.0 + lfo);
+                const int whole = static_cast<int>(delay);
+                const float frac = delay - whole;
+                const float a = m_chorusLine[(m_chorusIndex - whole) & chorusMask];
+                const float b = m_chorusLine[(m_chorusIndex - whole - 1) & chorusMask];
+                chorus += a + (b - a) * frac;
+            }
+            chorus *= m_chorusLevel;
+            left += chorus;
+            right += chorus;
+            m_chorusIndex = (m_chorusIndex + 1) & chorusMask;
+            m_chorusPhase += m_chorusStep;
+            if (m_chorusPhase >= 1.0) {
+                m_chorusPhase -= 1.0;
+            }
+        }
+        output[i * 2] += left;
+        output[i * 2 + 1] += right;
+        peak = qMax(peak, qMax(std::fabs(left), std::fabs(right)));
+    }
+    m_peak = peak;
+}
+
+/* the peak of the last wet block, to tell when the tails have decayed */
+float FluidEffects::peak() const
+{
+    return m_peak;
+}
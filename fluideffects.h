@@ -0,0 +1,93 @@
+/*
+    Drumstick RT (realtime MIDI In/Out) FluidLite Backend
+    Copyright (C) 2022, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FLUIDEFFECTS_H_
+#define FLUIDEFFECTS_H_
+
+#include <vector>
+
+/**
+ * Reverb and chorus for the effect sends, outside of FluidLite.
+ *
+ * The reverb is a Freeverb (eight parallel lowpass feedback combs and four
+ * series allpasses per side) and the chorus a set of sine modulated delay
+ * taps; both are modelled on the ones built into FluidLite, and take the
+ * same parameters, so they sound alike. process() reads interleaved frames
+ * of the reverb and chorus send pairs, and adds the wet signal to stereo
+ * frames. All buffers are allocated by setup(), so process() is realtime
+ * safe; while the sends are silent and the tails have decayed, it returns
+ * without any processing.
+ */
+class FluidEffects
+{
+public:
+    static const int SEND_CHANNELS = 4; // reverb left, right, chorus left, right
+    static const int COMBS = 8;
+    static const int ALLPASSES = 4;
+    static const int MAX_CHORUS_VOICES = 99;
+
+    FluidEffects();
+
+    void setup(int sampleRate, float silenceLevel);
+    void reset();
+    void setReverb(bool enabled, double roomSize, double damping, double width, double level);
+    void setChorus(bool enabled, int voices, double level, double speed, double depth);
+    void process(const float *sends, float *output, int frames);
+    float peak() const;
+
+private:
+    struct Comb {
+        std::vector<float> buffer;
+        int index;
+        float store;
+    };
+    struct Allpass {
+        std::vector<float> buffer;
+        int index;
+    };
+
+    void clearReverb();
+    void clearChorus();
+
+    int m_sampleRate;
+    float m_silenceLevel;
+    bool m_quiet;
+    float m_peak; // of the last wet block
+    int m_holdLength; // the longest path through the delay lines
+    int m_hold; // frames left before the tails can be measured
+
+    bool m_reverb;
+    Comb m_combs[2][COMBS];
+    Allpass m_allpasses[2][ALLPASSES];
+    float m_feedback;
+    float m_damp1;
+    float m_damp2;
+    float m_wet1;
+    float m_wet2;
+
+    bool m_chorus;
+    std::vector<float> m_chorusLine;
+    int m_chorusIndex;
+    int m_chorusVoices;
+    float m_chorusLevel;
+    double m_chorusPhase; // of the modulation, in cycles
+    double m_chorusStep;
+    float m_chorusDepth; // samples
+};
+
+#endif /*FLUIDEFFECTS_H_*/
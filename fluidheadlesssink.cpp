@@ -0,0 +1,137 @@
+/*
+    Drumstick RT (realtime MIDI In/Out) FluidLite Backend
+    Copyright (C) 2022, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QElapsedTimer>
+#include <vector>
+
+#include "fluiddefaults.h"
+#include "fluidheadlesssink.h"
+#include "fluidrenderer.h"
+
+FluidHeadlessSink::FluidHeadlessSink(FluidRenderer *renderer, QObject *parent):
+    QThread(parent),
+    m_renderer(renderer),
+    m_fileFormat(FluidAudioFileWriter::Wav),
+    m_bufferTime(FluidDefaults::DEFAULT_BUFFERTIME),
+    m_framesPlayed(0)
+{
+    //qDebug() << Q_FUNC_INFO;
+}
+
+FluidHeadlessSink::~FluidHeadlessSink()
+{
+    stop();
+    //qDebug() << Q_FUNC_INFO;
+}
+
+/**
+ * Writes the frames to a file, opened by start() with the channels and rate
+ * of the renderer; without a file name, they are discarded.
+ */
+bool FluidHeadlessSink::openFile(const QString &fileName, FluidAudioFileWriter::Format format)
+{
+    if (isRunning()) {
+        return false;
+    }
+    m_fileName = fileName;
+    m_fileFormat = format;
+    return true;
+}
+
+void FluidHeadlessSink::setBufferTime(int bufferTime)
+{
+    m_bufferTime = bufferTime;
+}
+
+int FluidHeadlessSink::bufferTime() const
+{
+    return m_bufferTime;
+}
+
+void FluidHeadlessSink::stop()
+{
+    //qDebug() << Q_FUNC_INFO;
+    if (isRunning()) {
+        requestInterruption();
+        wait();
+    }
+}
+
+/* safe to call from any thread */
+qint64 FluidHeadlessSink::framesPlayed() const
+{
+    return m_framesPlayed.load(std::memory_order_relaxed);
+}
+
+QString FluidHeadlessSink::errorString() const
+{
+    return m_writer.errorString();
+}
+
+/**
+ * Reads one buffer whenever the previous one would have been played, so
+ * the renderer sees the same requests as from a device, and its latency
+ * statistics measure the same. The renderer must be started, with float
+ * output samples.
+ */
+void FluidHeadlessSink::run()
+{
+    //qDebug() << Q_FUNC_INFO;
+    const int channels = m_renderer->channels();
+    const int rate = m_renderer->frameRate();
+    const qint64 bufferFrames = qMax<qint64>(m_renderer->renderingFrames(),
+        static_cast<qint64>(m_bufferTime) * rate / 1000 / m_renderer->renderingFrames() * m_renderer->renderingFrames());
+    std::vector<float> buffer(bufferFrames * channels);
+    if (!m_fileName.isEmpty() && !m_writer.open(m_fileName, m_fileFormat, rate, channels)) {
+        m_renderer->appendDiagnostics(fluid_log_level::FLUID_ERR, qPrintable(m_writer.errorString()));
+        return;
+    }
+    m_framesPlayed.store(0, std::memory_order_relaxed);
+    const qint64 NSECS = Q_INT64_C(1000000000);
+    const qint64 USECS = Q_INT64_C(1000000);
+    QElapsedTimer clock;
+    clock.start();
+    qint64 frames = 0;
+    while (!isInterruptionRequested()) {
+        const qint64 bytes = m_renderer->read(reinterpret_cast<char *>(buffer.data()),
+                                              static_cast<qint64>(buffer.size() * sizeof(float)));
+        if (bytes <= 0) {
+            break;
+        }
+        const int count = static_cast<int>(bytes / (channels * sizeof(float)));
+        if (m_writer.isOpen() && !m_writer.write(buffer.data(), count)) {
+            m_renderer->appendDiagnostics(fluid_log_level::FLUID_ERR, qPrintable(m_writer.errorString()));
+            break;
+        }
+        frames += count;
+        /* the frames played so far, with the rest waiting in the buffer; the
+           whole seconds are scaled apart, nsecs * rate overflows in a day */
+        const qint64 nsecs = clock.nsecsElapsed();
+        const qint64 played = nsecs / NSECS * rate + nsecs % NSECS * rate / NSECS;
+        m_framesPlayed.store(qMin(played, frames), std::memory_order_relaxed);
+        m_renderer->updateOutputLatency(static_cast<quint64>(qMin(played, frames)) * m_renderer->sampleRate() / rate);
+        const qint64 due = frames - bufferFrames;
+        const qint64 wait = due / rate * USECS + due % rate * USECS / rate - nsecs / 1000;
+        if (wait > 0) {
+            QThread::usleep(static_cast<unsigned long>(wait));
+        }
+    }
+    if (m_writer.isOpen()) {
+        m_writer.close();
+    }
+}
@@ -0,0 +1,64 @@
+/*
+    Drumstick RT (realtime MIDI In/Out) FluidLite Backend
+    Copyright (C) 2022, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FLUIDHEADLESSSINK_H_
+#define FLUIDHEADLESSSINK_H_
+
+#include <QThread>
+#include <QString>
+#include <atomic>
+
+#include "fluidaudiofile.h"
+
+class FluidRenderer;
+
+/**
+ * An audio sink without any audio device, for render servers and batch
+ * tools playing live MIDI: it pulls the renderer in real time, as a device
+ * with a buffer of bufferTime milliseconds would, writing the frames to a
+ * file, or discarding them without one. Rendering a workload as fast as
+ * possible doesn't need it, see FluidRenderer::renderOffline().
+ */
+class FluidHeadlessSink : public QThread
+{
+    Q_OBJECT
+
+public:
+    explicit FluidHeadlessSink(FluidRenderer *renderer, QObject *parent = nullptr);
+    ~FluidHeadlessSink();
+
+    bool openFile(const QString &fileName, FluidAudioFileWriter::Format format);
+    void setBufferTime(int bufferTime);
+    int bufferTime() const;
+    void stop();
+    qint64 framesPlayed() const;
+    QString errorString() const;
+
+protected:
+    void run() override;
+
+private:
+    FluidRenderer *m_renderer;
+    FluidAudioFileWriter m_writer;
+    QString m_fileName;
+    FluidAudioFileWriter::Format m_fileFormat;
+    int m_bufferTime;
+    std::atomic<qint64> m_framesPlayed;
+};
+
+#endif /*FLUIDHEADLESSSINK_H_*/
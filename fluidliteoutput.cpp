@@ -25,7 +25,8 @@ using namespace drumstick::rt;
 
 const QString FluidliteOutput::QSTR_FLUIDLITE = QStringLiteral("FluidLite");
 
-FluidliteOutput::FluidliteOutput(QObject *parent): MIDIOutput(parent)
+FluidliteOutput::FluidliteOutput(QObject *parent): MIDIOutput(parent),
+    m_port(0)
 {
     //qDebug() << Q_FUNC_INFO;
     m_synth = new FluidController(FluidController::DEFAULT_BUFFERTIME);
@@ -53,9 +54,7 @@ void FluidliteOutput::stop()
 void FluidliteOutput::initialize(QSettings* settings)
 {
     //qDebug() << Q_FUNC_INFO;
-    m_synth->readSettings(settings);
-    stop();
-    start();
+    m_synth->reconfigure(settings);
 }
 
 QString FluidliteOutput::backendName()
@@ -73,10 +72,25 @@ void FluidliteOutput::setPublicName(QString name)
     Q_UNUSED(name)
 }
 
+/* with several ports, "FluidLite 1" to "FluidLite N" */
+QString FluidliteOutput::portName(int port) const
+{
+    if (m_synth->renderer()->ports() == 1) {
+        return QSTR_FLUIDLITE;
+    }
+    return QString("%1 %2").arg(QSTR_FLUIDLITE).arg(port + 1);
+}
+
+/*
+ * A host sends through the one connection it has opened, so only the port
+ * that is opened is listed; the others are reachable through the renderer.
+ */
 QList<MIDIConnection> FluidliteOutput::connections(bool advanced)
 {
     Q_UNUSED(advanced)
-    return QList<MIDIConnection>{MIDIConnection(QSTR_FLUIDLITE,QSTR_FLUIDLITE)};
+    QList<MIDIConnection> result;
+    result << MIDIConnection(portName(openedPort()), portName(openedPort()));
+    return result;
 }
 
 void FluidliteOutput::setExcludedConnections(QStringList conns)
@@ -84,11 +98,33 @@ void FluidliteOutput::setExcludedConnections(QStringList conns)
     Q_UNUSED(conns)
 }
 
+/**
+ * Selects the port by its connection name, "FluidLite N" with several ports;
+ * the channels 0 to 15 sent through the plugin are those of that port.
+ */
 void FluidliteOutput::open(const MIDIConnection& conn)
 {
-    Q_UNUSED(conn)
     //qDebug() << Q_FUNC_INFO;
-    m_currentConnection = MIDIConnection(QSTR_FLUIDLITE,QSTR_FLUIDLITE);
+    m_port = 0;
+    for (int port = 0; port < m_synth->renderer()->ports(); ++port) {
+        if (conn.first == portName(port)) {
+            m_port = port;
+            break;
+        }
+    }
+    m_currentConnection = MIDIConnection(portName(m_port), portName(m_port));
+}
+
+/* the ports setting may have shrunk since open() */
+int FluidliteOutput::openedPort() const
+{
+    return qBound(0, m_port, m_synth->renderer()->ports() - 1);
+}
+
+/* the channel of the opened port, within the 16 * ports channels of the renderer */
+int FluidliteOutput::portChannel(int chan) const
+{
+    return openedPort() * 16 + (chan & 0x0F);
 }
 
 void FluidliteOutput::close()
@@ -105,42 +141,58 @@ MIDIConnection FluidliteOutput::currentConnection()
 
 void FluidliteOutput::sendNoteOff(int chan, int note, int vel)
 {
-    m_synth->renderer()->noteOff(chan, note, vel);
+    m_synth->renderer()->noteOff(portChannel(chan), note, vel);
 }
 
 void FluidliteOutput::sendNoteOn(int chan, int note, int vel)
 {
-    m_synth->renderer()->noteOn(chan, note, vel);
+    m_synth->renderer()->noteOn(portChannel(chan), note, vel);
 }
 
 void FluidliteOutput::sendKeyPressure(int chan, int note, int value)
 {
-    m_synth->renderer()->keyPressure(chan, note, value);
+    m_synth->renderer()->keyPressure(portChannel(chan), note, value);
 }
 
 void FluidliteOutput::sendController(int chan, int control, int value)
 {
-    m_synth->renderer()->controller(chan, control, value);
+    m_synth->renderer()->controller(portChannel(chan), control, value);
 }
 
 void FluidliteOutput::sendProgram(int chan, int program)
 {
-    m_synth->renderer()->program(chan, program);
+    m_synth->renderer()->program(portChannel(chan), program);
 }
 
 void FluidliteOutput::sendChannelPressure(int chan, int value)
 {
-    m_synth->renderer()->channelPressure(chan, value);
+    m_synth->renderer()->channelPressure(portChannel(chan), value);
 }
 
 void FluidliteOutput::sendPitchBend(int chan, int value)
 {
-    m_synth->renderer()->pitchBend(chan, value);
+    m_synth->renderer()->pitchBend(portChannel(chan), value);
 }
 
 void FluidliteOutput::sendSysex(const QByteArray &data)
 {
-    m_synth->renderer()->sysex(data);
+    m_synth->renderer()->sysex(data, openedPort());
+}
+
+/**
+ * Queues a packed buffer of raw MIDI messages for the opened port, applied
+ * together at the next block; returns the number of messages queued.
+ */
+int FluidliteOutput::sendMidiBatch(const QByteArray &data)
+{
+    return m_synth->renderer()->postMidi(data.constData(), data.size(), nullptr, 0, openedPort());
+}
+
+/* the same, with a frame offset from now for each channel or SysEx message */
+int FluidliteOutput::sendMidiBatch(const QByteArray &data, const QVector<int> &frameOffsets)
+{
+    return m_synth->renderer()->postMidi(data.constData(), data.size(),
+                                         frameOffsets.constData(), frameOffsets.size(), openedPort());
 }
 
 void FluidliteOutput::sendSystemMsg(const int status)
@@ -178,3 +230,58 @@ bool FluidliteOutput::getConfigurable()
 {
     return true;
 }
+
+int FluidliteOutput::getRingFill()
+{
+    return m_synth->renderer()->ringFillLevel();
+}
+
+qlonglong FluidliteOutput::getBlocksRendered()
+{
+    return m_synth->renderer()->stats().blocksRendered();
+}
+
+QVariantMap FluidliteOutput::getBlockTime()
+{
+    return m_synth->renderer()->stats().blockTime();
+}
+
+double FluidliteOutput::getDspLoad()
+{
+    return m_synth->renderer()->stats().dspLoad();
+}
+
+int FluidliteOutput::getActiveVoices()
+{
+    return m_synth->renderer()->stats().activeVoices();
+}
+
+qlonglong FluidliteOutput::getEventsProcessed()
+{
+    return m_synth->renderer()->stats().eventsProcessed();
+}
+
+qlonglong FluidliteOutput::getEventsDropped()
+{
+    return m_synth->renderer()->stats().eventsDropped();
+}
+
+QVariantMap FluidliteOutput::getLatency()
+{
+    return m_synth->renderer()->stats().latency();
+}
+
+int FluidliteOutput::getBufferTime()
+{
+    return m_synth->bufferTime();
+}
+
+QVariantMap FluidliteOutput::getGovernor()
+{
+    return m_synth->renderer()->governorStatus();
+}
+
+double FluidliteOutput::getEffectsLatency()
+{
+    return m_synth->renderer()->effectsLatency();
+}
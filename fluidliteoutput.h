@@ -21,6 +21,7 @@
 
 #include <QObject>
 #include <QScopedPointer>
+#include <QVector>
 #include <drumstick/rtmidioutput.h>
 #include "fluidcontroller.h"
 
@@ -34,6 +35,17 @@ class FluidliteOutput : public drumstick::rt::MIDIOutput
     Q_PROPERTY(QString libversion READ getLibVersion)
     Q_PROPERTY(bool status READ getStatus)
     Q_PROPERTY(bool isconfigurable READ getConfigurable)
+    Q_PROPERTY(int ringfill READ getRingFill)
+    Q_PROPERTY(qlonglong blocksrendered READ getBlocksRendered)
+    Q_PROPERTY(QVariantMap blocktime READ getBlockTime)
+    Q_PROPERTY(double dspload READ getDspLoad)
+    Q_PROPERTY(int activevoices READ getActiveVoices)
+    Q_PROPERTY(qlonglong eventsprocessed READ getEventsProcessed)
+    Q_PROPERTY(qlonglong eventsdropped READ getEventsDropped)
+    Q_PROPERTY(QVariantMap latency READ getLatency)
+    Q_PROPERTY(int buffertime READ getBufferTime)
+    Q_PROPERTY(QVariantMap governor READ getGovernor)
+    Q_PROPERTY(double effectslatency READ getEffectsLatency)
 
 public:
     explicit FluidliteOutput(QObject *parent = nullptr);
@@ -69,16 +81,35 @@ public slots:
 
     bool configure(QWidget *parent);
 
+    /* extension for hosts sending many events at once */
+    Q_INVOKABLE int sendMidiBatch(const QByteArray &data);
+    Q_INVOKABLE int sendMidiBatch(const QByteArray &data, const QVector<int> &frameOffsets);
+
 private:
     drumstick::rt::MIDIConnection m_currentConnection;
     FluidController* m_synth;
+    int m_port;
 
 private:
+    QString portName(int port) const;
+    int openedPort() const;
+    int portChannel(int chan) const;
     QStringList getAudioDevices();
     QStringList getDiagnostics();
     QString getLibVersion();
     bool getStatus();
     bool getConfigurable();
+    int getRingFill();
+    qlonglong getBlocksRendered();
+    QVariantMap getBlockTime();
+    double getDspLoad();
+    int getActiveVoices();
+    qlonglong getEventsProcessed();
+    qlonglong getEventsDropped();
+    QVariantMap getLatency();
+    int getBufferTime();
+    QVariantMap getGovernor();
+    double getEffectsLatency();
 };
 
 #endif // FLUIDLITEOUTPUT_H
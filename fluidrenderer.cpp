@@ -16,14 +16,23 @@
     along with this program. If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
+#include <limits>
+
 #include <QObject>
 #include <QDebug>
 #include <QString>
 #include <QCoreApplication>
+#include <QFileInfo>
+#include <QSysInfo>
 #include <QTextStream>
 
-#include "fluidcontroller.h"
+#include "fluidaudiofile.h"
+#include "fluiddefaults.h"
 #include "fluidrenderer.h"
+#include "fluidrenderthread.h"
+#include "fluidsoundfontcache.h"
+#include "fluidsoundfontloader.h"
 
 static void
 FluidRenderer_log_function(int level, char* message, void* data)
@@ -34,31 +43,89 @@ FluidRenderer_log_function(int level, char* message, void* data)
 
 FluidRenderer::FluidRenderer(QObject *parent):
     QIODevice(parent),
+    m_diagnostics(FluidDefaults::DEFAULT_DIAGNOSTICS_SIZE),
     m_status(false),
-    m_sampleRate(FluidController::DEFAULT_SAMPLERATE),
-    m_renderingFrames(FluidController::DEFAULT_RENDERING_FRAMES),
-    m_channels(FluidController::DEFAULT_FRAME_CHANNELS),
-    m_sample_size(sizeof(float) * CHAR_BIT),
-    m_gain(FluidController::DEFAULT_GAIN),
-    m_chorus(FluidController::DEFAULT_CHORUS),
-    m_reverb(FluidController::DEFAULT_REVERB),
-    m_polyphony(FluidController::DEFAULT_POLYPHONY),
+    m_sampleRate(FluidDefaults::DEFAULT_SAMPLERATE),
+    m_configuredRate(FluidDefaults::DEFAULT_SAMPLERATE),
+    m_outputRate(0),
+    m_resample(FluidDefaults::DEFAULT_RESAMPLE),
+    m_renderingFrames(FluidDefaults::DEFAULT_RENDERING_FRAMES),
+    m_channels(FluidDefaults::DEFAULT_FRAME_CHANNELS),
+    m_gain(FluidDefaults::DEFAULT_GAIN),
+    m_chorus(FluidDefaults::DEFAULT_CHORUS),
+    m_reverb(FluidDefaults::DEFAULT_REVERB),
+    m_polyphony(FluidDefaults::DEFAULT_POLYPHONY),
+    m_stems(FluidDefaults::DEFAULT_STEMS),
+    m_pipelinedEffects(FluidDefaults::DEFAULT_PIPELINEDEFFECTS),
+    m_partition(false),
+    m_effectsThread(nullptr),
+    m_effectsPending(false),
     m_settings(nullptr),
     m_synth(nullptr),
     m_sf2loaded(false),
     m_sfid(-1),
-    m_lastBufferSize(0)
+    m_liveGain(FluidDefaults::DEFAULT_GAIN),
+    m_liveChorus(FluidDefaults::DEFAULT_CHORUS),
+    m_liveReverb(FluidDefaults::DEFAULT_REVERB),
+    m_livePolyphony(FluidDefaults::DEFAULT_POLYPHONY),
+    m_liveGovernor(FluidDefaults::DEFAULT_POLYPHONYGOVERNOR),
+    m_liveSerial(0),
+    m_appliedSerial(0),
+    m_governor(FluidDefaults::DEFAULT_POLYPHONYGOVERNOR),
+    m_governorLimit(std::numeric_limits<int>::max()),
+    m_governorHeld(0),
+    m_governorQuiet(0),
+    m_lastNoteId(0),
+    m_masterVolume(1.0f),
+    m_silent(false),
+    m_idle(false),
+    m_suspended(false),
+    m_wakeRequested(false),
+    m_resumeNsecs(0),
+    m_events(FluidDefaults::DEFAULT_EVENT_QUEUE_SIZE),
+    m_sysexData(FluidDefaults::DEFAULT_SYSEX_QUEUE_SIZE),
+    m_sysexBuffer(FluidDefaults::DEFAULT_SYSEX_QUEUE_SIZE),
+    m_frameTime(0),
+    m_lastEventFrame(0),
+    m_clockSeq(0),
+    m_cycleFrame(0),
+    m_cycleNsecs(0),
+    m_deliveredFrames(0),
+    m_deliveredRemainder(0),
+    m_threaded(FluidDefaults::DEFAULT_RENDERTHREAD),
+    m_ringTime(0),
+    m_maxRingTime(0),
+    m_ringLimit(0),
+    m_renderThread(nullptr),
+    m_partitionCount(FluidDefaults::DEFAULT_PARTITIONS),
+    m_ports(FluidDefaults::DEFAULT_PORTS),
+    m_routing(nullptr),
+    m_routingUsers(0),
+    m_offline(false),
+    m_loader(nullptr),
+    m_pendingSynth(nullptr),
+    m_retiredSynth(nullptr),
+    m_pendingSfid(-1),
+    m_retiringSynth(nullptr),
+    m_retiringFrames(0),
+    m_latencyProbes(FluidDefaults::DEFAULT_LATENCY_PROBES),
+    m_lastBufferSize(0),
+    m_sampleFormat(FluidSampleConverter::Float),
+    m_sampleBytes(sizeof(float))
 {
     //qDebug() << Q_FUNC_INFO;
     m_diagnostics.clear();
+    m_clock.start();
+    initFormat();
 }
 
 void
 FluidRenderer::uninitialize()
 {
     //qDebug() << Q_FUNC_INFO;
+    stopLoader();
     if (m_synth != nullptr) {
-        delete_fluid_synth(m_synth);
+        deleteSynth(m_synth);
         m_synth = nullptr;
     }
     if (m_settings != nullptr) {
@@ -67,6 +134,8 @@ FluidRenderer::uninitialize()
     }
     m_status = false;
     m_diagnostics.clear();
+    /* the next format, for choosing the audio device before start() */
+    initFormat();
 }
 
 void
@@ -76,45 +145,109 @@ FluidRenderer::initialize()
     /* FluidLite initialization */
     m_runtimeLibraryVersion = fluid_version_str();
     //qDebug() << Q_FUNC_INFO << "Runtime FluidLite Version:" << m_runtimeLibraryVersion;
-    //fluid_set_log_function(fluid_log_level::FLUID_DBG, &FluidRenderer_log_function, this);
-    fluid_set_log_function(fluid_log_level::FLUID_ERR, &FluidRenderer_log_function, this);
-    fluid_set_log_function(fluid_log_level::FLUID_WARN, &FluidRenderer_log_function, this);
-    fluid_set_log_function(fluid_log_level::FLUID_INFO, &FluidRenderer_log_function, this);
+    setLogFunction();
     
+    m_sampleRate = effectiveRate(m_configuredRate);
+    initFormat();
     m_settings = new_fluid_settings();
     //fluid_settings_setstr(m_settings, "synth.verbose", "yes");
     fluid_settings_setnum(m_settings, "synth.sample-rate", m_sampleRate);
     fluid_settings_setnum(m_settings, "synth.gain", m_gain);
-    fluid_settings_setint(m_settings, "synth.chorus.active", m_chorus);
-    fluid_settings_setint(m_settings, "synth.reverb.active", m_reverb);
+    /* stems and pipelined effects are dry, the reverb and chorus are fed by separate sends */
+    fluid_settings_setint(m_settings, "synth.chorus.active", externalEffects() ? 0 : m_chorus);
+    fluid_settings_setint(m_settings, "synth.reverb.active", externalEffects() ? 0 : m_reverb);
     fluid_settings_setint(m_settings, "synth.polyphony", m_polyphony);
+    if (audioGroups() > 0) {
+        fluid_settings_setint(m_settings, "synth.audio-channels", audioGroups());
+        fluid_settings_setint(m_settings, "synth.audio-groups", audioGroups());
+    }
 
     m_synth = new_fluid_synth(m_settings);
+    /* also the limit for raising the polyphony later, without a new synth */
+    m_voiceList.assign(m_polyphony + 1, nullptr);
+    m_governorLimit = std::numeric_limits<int>::max();
+    m_governorHeld = 0;
+    m_governorQuiet = 0;
+    const int midiChannels = fluid_synth_count_midi_channels(m_synth);
+    m_heldNotes.clear();
+    m_heldNotes.reserve(midiChannels * 128);
+    m_noteIds.assign(midiChannels * 128, 0);
+    m_sustain.assign(midiChannels, false);
+    m_lastNoteId = 0;
+    m_shedList.reserve(m_voiceList.size());
+    m_masterVolume = 1.0f;
+    m_silent = false;
+    m_idle.store(false, std::memory_order_relaxed);
+    publishSettings();
+    m_appliedSerial = m_liveSerial.load(std::memory_order_relaxed);
+    m_retiringBuffer.assign(qMax(m_renderingFrames, FluidDefaults::DEFAULT_OFFLINE_FRAMES) * m_channels, 0.0f);
     if (!m_soundFont.isEmpty()) {
-        m_sfid = fluid_synth_sfload(m_synth, qPrintable(m_soundFont), 1);
+        m_sfid = FluidSoundFontCache::instance()->attach(m_synth, m_soundFont, this);
         m_sf2loaded = (m_sfid != -1);
+        if (!m_sf2loaded && !QFileInfo::exists(m_soundFont)) {
+            appendDiagnostics(fluid_log_level::FLUID_ERR, qPrintable(tr("SoundFont file not found: %1").arg(m_soundFont)));
+        }
         //qDebug() << Q_FUNC_INFO << "loaded soundfont" << m_sfid << m_soundFont;
     }
     //qDebug() << Q_FUNC_INFO << "synthesis frames:" << m_renderingFrames << "sample rate:" << m_sampleRate << "audio channels:" << m_channels;
 
-    /* QAudioFormat initialization */
-    m_format.setSampleRate(m_sampleRate);
-    m_format.setChannelCount(m_channels);
+    m_convertBuffer.assign(m_renderingFrames * m_channels, 0.0f);
+    initStems();
+    m_effects.setup(m_sampleRate, static_cast<float>(FluidDefaults::IDLE_SILENCE_LEVEL));
+    m_effectsPending = false;
+
+    /* the resampler, when the device runs at another rate */
+    m_resampler.setup(m_offline ? 0 : m_sampleRate, m_offline ? 0 : m_outputRate, m_channels, m_renderingFrames);
+    m_resampleBuffer.assign(m_resampler.isActive() ? m_renderingFrames * m_channels : 0, 0.0f);
+    if (m_resampler.isActive()) {
+        appendDiagnostics(fluid_log_level::FLUID_INFO,
+            qPrintable(tr("Synthesis at %1 Hz, resampled to %2 Hz (%3 ms latency)")
+                       .arg(m_sampleRate).arg(m_outputRate)
+                       .arg(m_resampler.latency() * 1000.0 / m_sampleRate, 0, 'f', 2)));
+    } else if (!m_offline && m_outputRate > 0) {
+        appendDiagnostics(fluid_log_level::FLUID_INFO,
+            qPrintable(tr("Synthesis at the native rate of the device: %1 Hz").arg(m_sampleRate)));
+    }
+    m_status = (m_synth != nullptr) && (m_sfid >= 0);
+}
+
+/* the FluidLite log function is global, the last renderer setting it gets the messages */
+void FluidRenderer::setLogFunction()
+{
+    //fluid_set_log_function(fluid_log_level::FLUID_DBG, &FluidRenderer_log_function, this);
+    fluid_set_log_function(fluid_log_level::FLUID_ERR, &FluidRenderer_log_function, this);
+    fluid_set_log_function(fluid_log_level::FLUID_WARN, &FluidRenderer_log_function, this);
+    fluid_set_log_function(fluid_log_level::FLUID_INFO, &FluidRenderer_log_function, this);
+}
+
+/**
+ * Float unless the device needs another format, see setOutputFormat(). The
+ * frames are stereo, or the stereo stems followed by the reverb and chorus
+ * send pairs.
+ */
+void FluidRenderer::initFormat()
+{
+    m_channels = (m_stems > 0) ? m_stems * 2 + FluidDefaults::STEM_SEND_CHANNELS
+                               : FluidDefaults::DEFAULT_FRAME_CHANNELS;
+#ifndef FLUID_HEADLESS
+    m_format.setSampleRate(frameRate());
 #if QT_VERSION < QT_VERSION_CHECK(6,0,0)
-    m_format.setSampleSize(m_sample_size);
+    m_format.setChannelCount(m_channels);
     m_format.setCodec("audio/pcm");
-    m_format.setSampleType(QAudioFormat::Float);
-    m_format.setByteOrder(QAudioFormat::LittleEndian);
+    m_format.setByteOrder(static_cast<QAudioFormat::Endian>(QSysInfo::ByteOrder));
 #else
-    m_format.setSampleFormat(QAudioFormat::Float);
-    m_format.setChannelConfig(QAudioFormat::ChannelConfigStereo);
+    m_format.setChannelConfig(m_stems > 0 ? QAudioFormat::ChannelConfigUnknown : QAudioFormat::ChannelConfigStereo);
+    m_format.setChannelCount(m_channels);
 #endif
-    m_status = (m_synth != nullptr) && (m_sfid >= 0);
+    setSampleFormat(m_format, FluidSampleConverter::Float);
+#endif
+    m_sampleFormat = FluidSampleConverter::Float;
+    m_sampleBytes = sizeof(float);
 }
 
 FluidRenderer::~FluidRenderer()
 {
-    uninitialize();
+    stop();
     //qDebug() << Q_FUNC_INFO;
 }
 
@@ -122,23 +255,567 @@ qint64 FluidRenderer::readData(char *data, qint64 maxlen)
 {
     //qDebug() << Q_FUNC_INFO << "starting with maxlen:" << maxlen;
     const qint64 bufferSamples = m_renderingFrames * m_channels;
-    const qint64 bufferBytes = bufferSamples * sizeof(float);
+    const qint64 bufferBytes = bufferSamples * m_sampleBytes;
     Q_ASSERT(bufferBytes > 0 && bufferBytes <= maxlen);
-    qint64 buflen = (maxlen / bufferBytes) * bufferBytes;
-    qint64 length = buflen;
-    
-    float *buffer = reinterpret_cast<float *>(data);
-    while (length > 0) {
-        fluid_synth_write_float(m_synth, m_renderingFrames, buffer, 0, m_channels, buffer, 1, m_channels);
-        length -= bufferBytes;
-        buffer += bufferSamples;
+    const qint64 buflen = (maxlen / bufferBytes) * bufferBytes;
+    const qint64 frames = buflen / (m_channels * m_sampleBytes);
+    /* float goes straight into the sink buffer, other formats through m_convertBuffer */
+    const bool convert = (m_sampleFormat != FluidSampleConverter::Float);
+
+    if (m_renderThread != nullptr) {
+        qint64 done = 0;
+        qint64 delivered = 0;
+        while (done < frames) {
+            const qint64 count = convert ? qMin<qint64>(m_renderingFrames, frames - done) : frames - done;
+            const size_t samples = count * m_channels;
+            float *buffer = convert ? m_convertBuffer.data() : reinterpret_cast<float *>(data) + done * m_channels;
+            const size_t ready = m_audioRing.read(buffer, samples);
+            delivered += ready / m_channels;
+            if (ready < samples) {
+                /* the render thread fell behind, play silence instead */
+                std::fill(buffer + ready, buffer + samples, 0.0f);
+            }
+            if (convert) {
+                FluidSampleConverter::convert(m_sampleFormat, buffer, data + done * m_channels * m_sampleBytes, samples);
+            }
+            done += count;
+        }
+        /* the silence played on an underrun is not rendered audio */
+        m_deliveredFrames.fetch_add(ringSynthFrames(delivered), std::memory_order_relaxed);
+        m_lastBufferSize = buflen;
+        return buflen;
     }
 
+    /* events arriving while this cycle renders are due in the next one */
+    publishClock(m_frameTime + synthFrames(frames));
+
+    for (qint64 done = 0; done < frames; done += m_renderingFrames) {
+        if (convert) {
+            renderOutput(m_convertBuffer.data(), m_renderingFrames);
+            FluidSampleConverter::convert(m_sampleFormat, m_convertBuffer.data(),
+                                          data + done * m_channels * m_sampleBytes, bufferSamples);
+        } else {
+            renderOutput(reinterpret_cast<float *>(data) + done * m_channels, m_renderingFrames);
+        }
+    }
+
+    m_deliveredFrames.store(m_frameTime, std::memory_order_relaxed);
     m_lastBufferSize = buflen;
     //qDebug() << Q_FUNC_INFO << "returning" << buflen;
     return buflen;
 }
 
+/**
+ * The synth renders one audio group per stem, or one per MIDI channel for
+ * the pipelined effects, weighting their sends; zero means a stereo mix.
+ */
+int FluidRenderer::audioGroups() const
+{
+    if (m_stems > 0) {
+        return m_stems;
+    }
+    return m_pipelinedEffects ? 16 : 0;
+}
+
+/* the reverb and chorus built into FluidLite are off */
+bool FluidRenderer::externalEffects() const
+{
+    return audioGroups() > 0;
+}
+
+/* planar buffers for fluid_synth_nwrite_float(), one stereo pair per audio group */
+void FluidRenderer::initStems()
+{
+    const int maxFrames = qMax(m_renderingFrames, FluidDefaults::DEFAULT_OFFLINE_FRAMES);
+    const int groups = audioGroups();
+    const size_t sendSamples = (m_stems == 0 && groups > 0) ? maxFrames * FluidEffects::SEND_CHANNELS : 0;
+    m_stemBuffer.assign(static_cast<size_t>(groups) * 2 * maxFrames, 0.0f);
+    m_stemLeft.resize(groups);
+    m_stemRight.resize(groups);
+    for (int group = 0; group < groups; ++group) {
+        m_stemLeft[group] = m_stemBuffer.data() + (group * 2) * maxFrames;
+        m_stemRight[group] = m_stemBuffer.data() + (group * 2 + 1) * maxFrames;
+    }
+    m_sendBuffer.assign(sendSamples, 0.0f);
+    m_retiringSends.assign(sendSamples, 0.0f);
+}
+
+/**
+ * Writes a segment of a synth as interleaved frames. With stems, MIDI
+ * channel chan sounds in stem chan % m_stems, and the reverb and chorus
+ * sends are the stems weighted by the CC 91 and CC 93 values of their
+ * channels, as the default SoundFont modulators do. With pipelined effects,
+ * the frames are the dry mix of the channels, and the sends go to sends.
+ */
+void FluidRenderer::writeSynth(fluid_synth_t *synth, int frames, float *buffer, float *sends)
+{
+    const int groups = audioGroups();
+    if (groups == 0) {
+        fluid_synth_write_float(synth, frames, buffer, 0, m_channels, buffer, 1, m_channels);
+        return;
+    }
+    fluid_synth_nwrite_float(synth, frames, m_stemLeft.data(), m_stemRight.data(), nullptr, nullptr);
+    float reverbSend[16];
+    float chorusSend[16];
+    std::fill(reverbSend, reverbSend + groups, 0.0f);
+    std::fill(chorusSend, chorusSend + groups, 0.0f);
+    for (int chan = 0; chan < 16; ++chan) {
+        int reverb = 0, chorus = 0;
+        fluid_synth_get_cc(synth, chan, 91, &reverb);
+        fluid_synth_get_cc(synth, chan, 93, &chorus);
+        const int channels = (16 - chan % groups + groups - 1) / groups;
+        reverbSend[chan % groups] += reverb / (127.0f * channels);
+        chorusSend[chan % groups] += chorus / (127.0f * channels);
+    }
+    for (int i = 0; i < frames; ++i) {
+        float *frame = buffer + i * m_channels;
+        float dryLeft = 0.0f, dryRight = 0.0f;
+        float reverbLeft = 0.0f, reverbRight = 0.0f, chorusLeft = 0.0f, chorusRight = 0.0f;
+        for (int group = 0; group < groups; ++group) {
+            const float left = m_stemLeft[group][i];
+            const float right = m_stemRight[group][i];
+            if (m_stems > 0) {
+                frame[group * 2] = left;
+                frame[group * 2 + 1] = right;
+            } else {
+                dryLeft += left;
+                dryRight += right;
+            }
+            reverbLeft += left * reverbSend[group];
+            reverbRight += right * reverbSend[group];
+            chorusLeft += left * chorusSend[group];
+            chorusRight += right * chorusSend[group];
+        }
+        float *send = (m_stems > 0) ? frame + m_stems * 2 : sends + i * FluidEffects::SEND_CHANNELS;
+        if (m_stems == 0) {
+            frame[0] = dryLeft;
+            frame[1] = dryRight;
+        }
+        send[0] = reverbLeft;
+        send[1] = reverbRight;
+        send[2] = chorusLeft;
+        send[3] = chorusRight;
+    }
+}
+
+/* runs on the audio thread while the effects thread is idle */
+void FluidRenderer::updateEffects()
+{
+    m_effects.setReverb(m_liveReverb.load(std::memory_order_relaxed) > 0,
+                        fluid_synth_get_reverb_roomsize(m_synth), fluid_synth_get_reverb_damp(m_synth),
+                        fluid_synth_get_reverb_width(m_synth), fluid_synth_get_reverb_level(m_synth));
+    m_effects.setChorus(m_liveChorus.load(std::memory_order_relaxed) > 0,
+                        fluid_synth_get_chorus_nr(m_synth), fluid_synth_get_chorus_level(m_synth),
+                        fluid_synth_get_chorus_speed_Hz(m_synth), fluid_synth_get_chorus_depth_ms(m_synth));
+}
+
+/**
+ * Adds the reverb and chorus of the block sends to the stereo mix. With the
+ * effects thread, it processes the sends of each block while the next one
+ * renders, and its wet output is mixed into that next block, one block late.
+ * Offline, they are processed inline instead.
+ */
+void FluidRenderer::processEffects(float *buffer, int frames)
+{
+    if (m_effectsThread == nullptr) {
+        updateEffects();
+        m_effects.process(m_sendBuffer.data(), buffer, frames);
+    } else {
+        if (m_effectsPending) {
+            const int wetFrames = qMin(frames, m_effectsThread->waitProcessed());
+            const float *wet = m_effectsThread->wet();
+            for (int i = 0; i < wetFrames * m_channels; ++i) {
+                buffer[i] += wet[i];
+            }
+        }
+        updateEffects();
+        m_effectsThread->process(m_sendBuffer.data(), frames);
+        m_effectsPending = true;
+    }
+    /* the synths may be silent while the tails still sound */
+    if (m_effects.peak() > static_cast<float>(FluidDefaults::IDLE_SILENCE_LEVEL)) {
+        m_idle.store(false, std::memory_order_relaxed);
+    } else if (m_silent) {
+        m_idle.store(true, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * Renders frames at the output rate, through the resampler when the synth
+ * runs at another rate.
+ */
+void FluidRenderer::renderOutput(float *buffer, int frames)
+{
+    if (!m_resampler.isActive()) {
+        render(buffer, frames);
+        return;
+    }
+    int done = m_resampler.read(buffer, frames);
+    while (done < frames) {
+        render(m_resampleBuffer.data(), m_renderingFrames);
+        m_resampler.write(m_resampleBuffer.data(), m_renderingFrames);
+        done += m_resampler.read(buffer + done * m_channels, frames - done);
+    }
+}
+
+/* output frames taken from the ring to synth frames, carrying the remainder */
+quint64 FluidRenderer::ringSynthFrames(qint64 outputFrames)
+{
+    if (!m_resampler.isActive()) {
+        return outputFrames;
+    }
+    const qint64 scaled = outputFrames * m_sampleRate + m_deliveredRemainder;
+    m_deliveredRemainder = scaled % m_outputRate;
+    return scaled / m_outputRate;
+}
+
+/* output frames to synth frames, rounded up */
+quint64 FluidRenderer::synthFrames(qint64 outputFrames) const
+{
+    if (!m_resampler.isActive()) {
+        return outputFrames;
+    }
+    return (outputFrames * m_sampleRate + m_outputRate - 1) / m_outputRate;
+}
+
+/* the synthesis rate: the output rate, unless resampling from another rate */
+int FluidRenderer::effectiveRate(int configuredRate) const
+{
+    return (m_resample || m_offline || m_outputRate <= 0) ? configuredRate : m_outputRate;
+}
+
+/**
+ * Renders one block, splitting it at the frame offsets of the pending events.
+ * FluidLite applies events at its internal 64 frame (FLUID_BUFSIZE) boundaries,
+ * so this is the effective precision regardless of the rendering block size.
+ */
+int FluidRenderer::render(float *buffer, int frames)
+{
+    const int MAX_PROBES = 8;
+    float * const output = buffer;
+    float *sends = m_sendBuffer.data();
+    const int sendChannels = m_sendBuffer.empty() ? 0 : FluidEffects::SEND_CHANNELS;
+    const qint64 started = m_clock.nsecsElapsed();
+    const quint64 blockEnd = m_frameTime + frames;
+    int events = 0;
+    int probes = 0;
+    qint64 arrivals[MAX_PROBES];
+    if (m_retiringSynth == nullptr && m_pendingSynth.load(std::memory_order_acquire) != nullptr) {
+        swapSynth();
+    }
+    if (m_liveSerial.load(std::memory_order_acquire) != m_appliedSerial) {
+        applySettings(m_synth);
+    }
+    for (FluidPartitionThread *thread : m_partitionThreads) {
+        thread->render(frames);
+    }
+    while (m_frameTime < blockEnd) {
+        quint64 segmentEnd = blockEnd;
+        const FluidMidiEvent *next;
+        while ((next = m_events.front()) != nullptr) {
+            if (next->frame > m_frameTime) {
+                if (next->frame < blockEnd) {
+                    segmentEnd = next->frame;
+                }
+                break;
+            }
+            FluidMidiEvent ev;
+            m_events.pop(ev);
+            processEvent(ev);
+            ++events;
+            m_silent = false;
+            if (ev.type == FluidMidiEvent::NoteOn && probes < MAX_PROBES && !m_offline) {
+                arrivals[probes++] = ev.nsecs;
+            }
+        }
+        const int segment = static_cast<int>(segmentEnd - m_frameTime);
+        if (m_silent) {
+            std::fill(buffer, buffer + segment * m_channels, 0.0f);
+            std::fill(sends, sends + segment * sendChannels, 0.0f);
+        } else {
+            writeSynth(m_synth, segment, buffer, sends);
+        }
+        if (m_retiringSynth != nullptr) {
+            float *tail = m_retiringBuffer.data();
+            writeSynth(m_retiringSynth, segment, tail, m_retiringSends.data());
+            for (int i = 0; i < segment * m_channels; ++i) {
+                buffer[i] += tail[i];
+            }
+            for (int i = 0; i < segment * sendChannels; ++i) {
+                sends[i] += m_retiringSends[i];
+            }
+        }
+        buffer += segment * m_channels;
+        sends += segment * sendChannels;
+        m_frameTime = segmentEnd;
+    }
+    const qint64 budget = frames * Q_INT64_C(1000000000) / m_sampleRate;
+    shedVoices();
+    if (!m_silent && m_retiringSynth == nullptr) {
+        detectSilence(output, frames);
+    }
+    if (m_retiringSynth != nullptr) {
+        retireSynth(frames);
+    }
+    for (size_t p = 0; p < m_partitionThreads.size(); ++p) {
+        events += m_partitionThreads[p]->waitRendered();
+        const float *partition = m_partitionThreads[p]->buffer();
+        for (int i = 0; i < frames * m_channels; ++i) {
+            output[i] += partition[i];
+        }
+        const float *partitionSends = m_partitions[p]->m_sendBuffer.data();
+        for (int i = 0; i < frames * sendChannels; ++i) {
+            m_sendBuffer[i] += partitionSends[i];
+        }
+    }
+    if (sendChannels > 0 && !m_partition) {
+        processEffects(output, frames);
+    }
+    if (!m_partition) {
+        /* the whole block, waiting for the partitions, which get the same limit */
+        governPolyphony(m_clock.nsecsElapsed() - started, budget, frames);
+    }
+    const qint64 finished = m_clock.nsecsElapsed();
+    m_stats.addBlock(finished - started, budget, events, activeVoiceCount());
+    for (int i = 0; i < probes; ++i) {
+        m_stats.addRenderLatency(finished - arrivals[i]);
+    }
+    if (probes > 0) {
+        /* follow one note per block until the sink consumes it */
+        LatencyProbe probe { blockEnd - frames, arrivals[0] };
+        m_latencyProbes.push(probe);
+    }
+    return events;
+}
+
+/**
+ * Called periodically by the controller with the number of frames already
+ * consumed by the audio sink; completes the latency of the probes in them,
+ * interpolating the time when the probe frame itself was consumed.
+ */
+void FluidRenderer::updateOutputLatency(quint64 consumedFrames)
+{
+    const qint64 now = m_clock.nsecsElapsed();
+    const LatencyProbe *probe;
+    while ((probe = m_latencyProbes.front()) != nullptr && probe->frame <= consumedFrames) {
+        const qint64 late = static_cast<qint64>(consumedFrames - probe->frame) * Q_INT64_C(1000000000) / m_sampleRate;
+        m_stats.addOutputLatency(now - late - probe->nsecs);
+        LatencyProbe done;
+        m_latencyProbes.pop(done);
+    }
+}
+
+/**
+ * Without sounding voices, and once the reverb and chorus tails decay below
+ * IDLE_SILENCE_LEVEL for a whole block, render() stops calling FluidLite and
+ * zero fills, until the next event is processed.
+ */
+void FluidRenderer::detectSilence(const float *buffer, int frames)
+{
+    if (voiceCount(m_synth) > 0) {
+        m_idle.store(false, std::memory_order_relaxed);
+        return;
+    }
+    const float level = static_cast<float>(FluidDefaults::IDLE_SILENCE_LEVEL);
+    for (int i = 0; i < frames * m_channels; ++i) {
+        if (buffer[i] > level || buffer[i] < -level) {
+            m_idle.store(false, std::memory_order_relaxed);
+            return;
+        }
+    }
+    m_silent = true;
+    m_idle.store(true, std::memory_order_relaxed);
+}
+
+/* all the synths are silent, safe to call from any thread */
+bool FluidRenderer::idle() const
+{
+    if (!m_idle.load(std::memory_order_relaxed)) {
+        return false;
+    }
+    for (FluidRenderer *partition : m_partitions) {
+        if (!partition->idle()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * While the audio sink is suspended, events are stamped at the end of the
+ * last rendered cycle, so they play as soon as it resumes. The first event
+ * posted while suspended emits wakeRequested().
+ */
+void FluidRenderer::setSuspended(bool suspended)
+{
+    if (!suspended) {
+        m_resumeNsecs.store(m_clock.nsecsElapsed(), std::memory_order_relaxed);
+    }
+    m_wakeRequested.store(false, std::memory_order_relaxed);
+    m_suspended.store(suspended, std::memory_order_release);
+    if (!suspended) {
+        /* parked since the last block, ready for the next ones */
+        for (FluidPartitionThread *thread : m_partitionThreads) {
+            thread->wakeUp();
+        }
+        if (m_effectsThread != nullptr) {
+            m_effectsThread->wakeUp();
+        }
+    }
+}
+
+bool FluidRenderer::suspended() const
+{
+    return m_suspended.load(std::memory_order_relaxed);
+}
+
+void FluidRenderer::wake()
+{
+    if (m_suspended.load(std::memory_order_relaxed) && !m_wakeRequested.exchange(true)) {
+        emit wakeRequested();
+    }
+}
+
+/**
+ * Called repeatedly by the render thread: renders whole blocks while there
+ * is room in the ring, and returns the number of frames rendered.
+ */
+int FluidRenderer::renderAhead()
+{
+    const size_t blockSamples = m_renderingFrames * m_channels;
+    const size_t limit = m_ringLimit.load(std::memory_order_relaxed);
+    int frames = 0;
+    while (m_audioRing.writeAvailable() >= blockSamples && m_audioRing.size() + blockSamples <= limit) {
+        publishClock(m_frameTime + synthFrames(m_renderingFrames));
+        renderOutput(m_renderBuffer.data(), m_renderingFrames);
+        m_audioRing.write(m_renderBuffer.data(), blockSamples);
+        frames += m_renderingFrames;
+    }
+    return frames;
+}
+
+/**
+ * Renders frames as fast as possible into the writer, without any audio
+ * device. Events posted between calls are due at the current frame, unless
+ * posted with an explicit frame. The render path, and therefore the output,
+ * is the same as in live playback. Returns the number of frames written.
+ */
+qint64 FluidRenderer::renderOffline(FluidAudioFileWriter *writer, qint64 frames)
+{
+    const int chunk = FluidDefaults::DEFAULT_OFFLINE_FRAMES;
+    if (m_synth == nullptr || !m_offline || writer == nullptr) {
+        return 0;
+    }
+    m_renderBuffer.resize(chunk * m_channels);
+    qint64 done = 0;
+    while (done < frames) {
+        const int count = static_cast<int>(qMin<qint64>(chunk, frames - done));
+        render(m_renderBuffer.data(), count);
+        if (!writer->write(m_renderBuffer.data(), count)) {
+            break;
+        }
+        done += count;
+    }
+    publishClock(m_frameTime);
+    return done;
+}
+
+void FluidRenderer::setOffline(bool enabled)
+{
+    m_offline = enabled;
+}
+
+bool FluidRenderer::offline() const
+{
+    return m_offline;
+}
+
+/**
+ * The render thread keeps up to ringTime milliseconds rendered ahead, in a
+ * ring allocated at start() for maxRingTime milliseconds.
+ */
+void FluidRenderer::setRenderThread(bool enabled, int ringTime, int maxRingTime)
+{
+    m_threaded = enabled;
+    m_maxRingTime = qMax(ringTime, maxRingTime);
+    setRingTime(ringTime);
+}
+
+/* may be called while the render thread runs; clamped to the ring capacity */
+void FluidRenderer::setRingTime(int ringTime)
+{
+    m_ringTime = qMin(ringTime, m_maxRingTime);
+    const size_t ringSamples = static_cast<size_t>(qMax(m_ringTime * frameRate() / 1000, m_renderingFrames)) * m_channels;
+    m_ringLimit.store(qMin(ringSamples, m_audioRing.capacity()), std::memory_order_relaxed);
+}
+
+int FluidRenderer::maxRingTime() const
+{
+    return m_maxRingTime;
+}
+
+bool FluidRenderer::renderThread() const
+{
+    return m_threaded;
+}
+
+int FluidRenderer::ringFillLevel() const
+{
+    const size_t limit = m_ringLimit.load(std::memory_order_relaxed);
+    if (m_renderThread == nullptr || limit == 0) {
+        return 0;
+    }
+    return static_cast<int>(qMin<size_t>(m_audioRing.size() * 100 / limit, 100));
+}
+
+unsigned long FluidRenderer::blockDuration() const
+{
+    return static_cast<unsigned long>(m_renderingFrames * 1000000LL / m_sampleRate);
+}
+
+void FluidRenderer::publishClock(quint64 cycleEnd)
+{
+    m_clockSeq.fetch_add(1, std::memory_order_acq_rel);
+    m_cycleFrame.store(cycleEnd, std::memory_order_relaxed);
+    m_cycleNsecs.store(m_clock.nsecsElapsed(), std::memory_order_relaxed);
+    m_clockSeq.fetch_add(1, std::memory_order_release);
+}
+
+/**
+ * Returns the frame time for an event sent right now: the end of the cycle
+ * being rendered plus the wall time elapsed since that cycle started. Events
+ * get a constant delay of one cycle instead of a variable block jitter.
+ */
+quint64 FluidRenderer::currentFrame() const
+{
+    return frameAt(m_clock.nsecsElapsed());
+}
+
+/* frames already handed to the audio sink, safe to call from any thread */
+quint64 FluidRenderer::deliveredFrames() const
+{
+    return m_deliveredFrames.load(std::memory_order_relaxed);
+}
+
+quint64 FluidRenderer::frameAt(qint64 now) const
+{
+    quint32 seq;
+    quint64 frame;
+    qint64 nsecs;
+    do {
+        seq = m_clockSeq.load(std::memory_order_acquire);
+        frame = m_cycleFrame.load(std::memory_order_relaxed);
+        nsecs = m_cycleNsecs.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+    } while ((seq & 1) || seq != m_clockSeq.load(std::memory_order_relaxed));
+    if (m_offline || nsecs == 0 || m_suspended.load(std::memory_order_relaxed)) {
+        return frame;
+    }
+    /* the time while the sink was suspended doesn't count */
+    const qint64 elapsed = qMax<qint64>(0, now - qMax(nsecs, m_resumeNsecs.load(std::memory_order_relaxed)));
+    return frame + static_cast<quint64>(elapsed * m_sampleRate / 1000000000);
+}
+
 qint64 FluidRenderer::writeData(const char *data, qint64 len)
 {
     Q_UNUSED(data);
@@ -171,77 +848,902 @@ FluidRenderer::start()
 {
     //qDebug() << Q_FUNC_INFO;
     initialize();
+    /* events sent while stopped are stale, discard them */
+    m_events.clear();
+    m_sysexData.clear();
+    m_frameTime = 0;
+    m_lastEventFrame = 0;
+    m_deliveredFrames.store(0, std::memory_order_relaxed);
+    m_deliveredRemainder = 0;
+    m_stats.reset();
+    m_stats.setPolyphony(m_polyphony);
+    m_latencyProbes.clear();
+    publishClock(0);
     open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+    startPartitions();
+    if (!m_sendBuffer.empty() && !m_partition && !m_offline && m_synth != nullptr) {
+        m_effectsThread = new FluidEffectsThread(&m_effects, qMax(m_renderingFrames, FluidDefaults::DEFAULT_OFFLINE_FRAMES));
+        m_effectsThread->start(QThread::TimeCriticalPriority);
+        appendDiagnostics(fluid_log_level::FLUID_INFO,
+            qPrintable(tr("Reverb and chorus pipelined on a second thread, %1 ms behind the dry signal")
+                       .arg(effectsLatency(), 0, 'f', 2)));
+    }
+    if (m_threaded && !m_offline && m_synth != nullptr) {
+        const int ringFrames = m_maxRingTime * frameRate() / 1000;
+        m_audioRing.resize(qMax(ringFrames, m_renderingFrames) * m_channels);
+        setRingTime(m_ringTime);
+        m_renderBuffer.resize(m_renderingFrames * m_channels);
+        m_renderThread = new FluidRenderThread(this);
+        m_renderThread->start(QThread::TimeCriticalPriority);
+    }
 }
 
 void
 FluidRenderer::stop()
 {
     //qDebug() << Q_FUNC_INFO;
+    if (m_renderThread != nullptr) {
+        m_renderThread->requestInterruption();
+        m_renderThread->wait();
+        delete m_renderThread;
+        m_renderThread = nullptr;
+    }
+    if (m_effectsThread != nullptr) {
+        m_effectsThread->stop();
+        delete m_effectsThread;
+        m_effectsThread = nullptr;
+    }
+    stopPartitions();
     if (isOpen()) {
         close();
     }
     uninitialize();
 }
 
+/**
+ * The partitions are offline renderers driven by render(), so their frame
+ * time follows this one. Each one loads its own SoundFonts, as they render
+ * at the same time, see FluidSoundFontCache.
+ * There are m_partitionCount of them for each port, including this one.
+ */
+void FluidRenderer::startPartitions()
+{
+    const int maxFrames = qMax(m_renderingFrames, FluidDefaults::DEFAULT_OFFLINE_FRAMES);
+    for (int i = 1; i < m_ports * m_partitionCount && m_synth != nullptr; ++i) {
+        FluidRenderer *partition = new FluidRenderer();
+        partition->m_configuredRate = m_sampleRate;
+        partition->m_renderingFrames = m_renderingFrames;
+        partition->m_gain = m_gain;
+        partition->m_chorus = m_chorus;
+        partition->m_reverb = m_reverb;
+        partition->m_polyphony = m_polyphony;
+        partition->m_governor = m_governor;
+        partition->m_stems = m_stems;
+        partition->m_pipelinedEffects = m_pipelinedEffects;
+        partition->m_partition = true;
+        partition->m_soundFont = m_soundFont;
+        partition->setOffline(true);
+        partition->start();
+        m_status = m_status && partition->getStatus();
+        FluidPartitionThread *thread = new FluidPartitionThread(partition, maxFrames, m_channels);
+        thread->start(QThread::TimeCriticalPriority);
+        m_partitions.push_back(partition);
+        m_partitionThreads.push_back(thread);
+    }
+    if (!m_partitions.empty()) {
+        setLogFunction();
+    }
+    /* events are accepted from now on */
+    FluidRouting *routing = new FluidRouting;
+    routing->ports = m_partitions.empty() ? 1 : m_ports;
+    routing->partitions = m_partitions.empty() ? 1 : m_partitionCount;
+    routing->renderers.push_back(this);
+    routing->renderers.insert(routing->renderers.end(), m_partitions.begin(), m_partitions.end());
+    m_routing.store(routing);
+}
+
+void FluidRenderer::stopPartitions()
+{
+    /* events are rejected from now on; wait for the MIDI thread to leave the table */
+    const FluidRouting *routing = m_routing.exchange(nullptr);
+    while (m_routingUsers.load() > 0) {
+        QThread::yieldCurrentThread();
+    }
+    delete routing;
+    for (FluidPartitionThread *thread : m_partitionThreads) {
+        thread->stop();
+        delete thread;
+    }
+    m_partitionThreads.clear();
+    for (FluidRenderer *partition : m_partitions) {
+        partition->stop();
+        delete partition;
+    }
+    m_partitions.clear();
+}
+
+/* the payload goes first, so it is complete when the consumer sees the event */
+bool FluidRenderer::postSysEx(FluidRenderer *target, const FluidMidiEvent &ev, const char *payload)
+{
+    const size_t length = static_cast<size_t>(ev.value);
+    if (target->m_sysexData.writeAvailable() < length || target->m_events.writeAvailable() == 0) {
+        m_stats.addDroppedEvent();
+        return false;
+    }
+    target->m_sysexData.write(payload, length);
+    target->m_events.push(ev);
+    wake();
+    return true;
+}
+
+/* chan is 16 * port + channel, see FluidRouting; out of range ones are dropped */
+void FluidRenderer::postEvent(quint8 type, int chan, int data1, int value)
+{
+    if (chan < 0 || chan > std::numeric_limits<quint8>::max()) {
+        m_stats.addDroppedEvent();
+        return;
+    }
+    postEvent(stampEvent(type, chan, data1, value));
+}
+
+FluidMidiEvent FluidRenderer::stampEvent(quint8 type, int chan, int data1, int value)
+{
+    FluidMidiEvent ev;
+    /* keep the stamps monotonic across cycle boundaries, preserving MIDI order */
+    ev.nsecs = m_clock.nsecsElapsed();
+    m_lastEventFrame = qMax(m_lastEventFrame, frameAt(ev.nsecs));
+    ev.frame = m_lastEventFrame;
+    ev.type = type;
+    ev.chan = static_cast<quint8>(chan);
+    ev.data1 = static_cast<quint8>(data1);
+    ev.reserved = 0;
+    ev.value = value;
+    return ev;
+}
+
+/**
+ * Queues an event to be rendered at ev.frame; callers wanting a frame offset
+ * relative to now should use currentFrame() + offset. Events must be posted
+ * in nondecreasing frame order, and ev.nsecs is stamped here when left zero.
+ * Returns false if the queue is full.
+ */
+bool FluidRenderer::postEvent(FluidMidiEvent ev)
+{
+    if (ev.nsecs == 0) {
+        ev.nsecs = m_clock.nsecsElapsed();
+    }
+    const RoutingScope scope(this);
+    if (scope.table() == nullptr) {
+        /* not started, or stopping */
+        m_stats.addDroppedEvent();
+        return false;
+    }
+    if (ev.chan >= 16 * scope.table()->ports) {
+        m_stats.addDroppedEvent();
+        return false;
+    }
+    FluidRenderer *partition = scope.table()->partitionOf(ev.chan);
+    ev.chan %= 16;
+    if (!partition->m_events.push(ev)) {
+        m_stats.addDroppedEvent();
+        return false;
+    }
+    wake();
+    return true;
+}
+
+void FluidRenderer::processEvent(const FluidMidiEvent &ev)
+{
+    switch (ev.type) {
+    case FluidMidiEvent::NoteOff:
+        fluid_synth_noteoff(m_synth, ev.chan, ev.data1);
+        trackNoteOff(ev.chan, ev.data1);
+        break;
+    case FluidMidiEvent::NoteOn:
+        fluid_synth_noteon(m_synth, ev.chan, ev.data1, ev.value);
+        if (ev.value > 0) {
+            trackNoteOn(ev.chan, ev.data1, ev.value);
+        } else {
+            trackNoteOff(ev.chan, ev.data1);
+        }
+        break;
+    case FluidMidiEvent::KeyPressure:
+        fluid_synth_key_pressure(m_synth, ev.chan, ev.data1, ev.value);
+        break;
+    case FluidMidiEvent::Controller:
+        fluid_synth_cc(m_synth, ev.chan, ev.data1, ev.value);
+        if (ev.chan >= 0 && ev.chan < static_cast<int>(m_sustain.size())) {
+            if (ev.data1 == 64 || ev.data1 == 121) {
+                m_sustain[ev.chan] = (ev.data1 == 64 && ev.value >= 64);
+                if (!m_sustain[ev.chan]) {
+                    forgetNotes(ev.chan, true);
+                }
+            } else if (ev.data1 == 120 || ev.data1 == 123) {
+                forgetNotes(ev.chan, false);
+            }
+        }
+        break;
+    case FluidMidiEvent::Program:
+        fluid_synth_program_change(m_synth, ev.chan, ev.value);
+        break;
+    case FluidMidiEvent::ChannelPressure:
+        fluid_synth_channel_pressure(m_synth, ev.chan, ev.value);
+        break;
+    case FluidMidiEvent::PitchBend:
+        fluid_synth_pitch_bend(m_synth, ev.chan, ev.value);
+        break;
+    case FluidMidiEvent::SysEx: {
+        /* used in place, unless the payload wraps around the end of the ring */
+        const size_t length = static_cast<size_t>(ev.value);
+        size_t contiguous;
+        const char *payload = m_sysexData.readRegion(contiguous);
+        if (contiguous >= length) {
+            processSysEx(payload, ev.value);
+            m_sysexData.skip(length);
+        } else {
+            const size_t len = m_sysexData.read(m_sysexBuffer.data(), length);
+            processSysEx(m_sysexBuffer.data(), static_cast<int>(len));
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+/**
+ * System Exclusive payload, without F0 and F7. The GM, GS and XG resets and
+ * the universal master volume are handled here; anything else goes to the
+ * FluidLite parser, which only knows about MIDI tuning messages.
+ */
+void FluidRenderer::processSysEx(const char *data, int length)
+{
+    const quint8 *msg = reinterpret_cast<const quint8 *>(data);
+    const bool gmReset = (length == 4 && msg[0] == 0x7E && msg[2] == 0x09 &&
+                          msg[3] >= 0x01 && msg[3] <= 0x03);
+    const bool gsReset = (length == 9 && msg[0] == 0x41 && msg[2] == 0x42 && msg[3] == 0x12 &&
+                          msg[4] == 0x40 && msg[5] == 0x00 && msg[6] == 0x7F && msg[7] == 0x00);
+    const bool xgReset = (length == 7 && msg[0] == 0x43 && (msg[1] & 0xF0) == 0x10 && msg[2] == 0x4C &&
+                          msg[3] == 0x00 && msg[4] == 0x00 && msg[5] == 0x7E && msg[6] == 0x00);
+    if (gmReset || gsReset || xgReset) {
+        fluid_synth_system_reset(m_synth);
+        forgetNotes(-1, false);
+        std::fill(m_sustain.begin(), m_sustain.end(), false);
+        m_masterVolume = 1.0f;
+        fluid_synth_set_gain(m_synth, m_liveGain.load(std::memory_order_relaxed));
+    } else if (length == 6 && msg[0] == 0x7F && msg[2] == 0x04 && msg[3] == 0x01) {
+        m_masterVolume = ((msg[5] & 0x7F) << 7 | (msg[4] & 0x7F)) / 16383.0f;
+        fluid_synth_set_gain(m_synth, m_liveGain.load(std::memory_order_relaxed) * m_masterVolume);
+    } else {
+        fluid_synth_sysex(m_synth, data, length, nullptr, nullptr, nullptr, 0);
+    }
+}
+
 void FluidRenderer::noteOn(const int chan, const int note, const int vel)
 {
     //qDebug() << Q_FUNC_INFO << chan << note << vel;
-    fluid_synth_noteon(m_synth, chan, note, vel);
+    postEvent(FluidMidiEvent::NoteOn, chan, note, vel);
 }
 
 void FluidRenderer::noteOff(const int chan, const int note, const int vel)
 {
     Q_UNUSED(vel)
     //qDebug() << Q_FUNC_INFO << chan << note;
-    fluid_synth_noteoff(m_synth, chan, note);
+    postEvent(FluidMidiEvent::NoteOff, chan, note, 0);
 }
 
 void FluidRenderer::keyPressure(const int chan, const int note, const int value) 
 {
     //qDebug() << Q_FUNC_INFO << chan << note << value;
-    fluid_synth_key_pressure(m_synth, chan, note, value);
+    postEvent(FluidMidiEvent::KeyPressure, chan, note, value);
 }
 
 void FluidRenderer::controller(const int chan, const int control, const int value) 
 {
     //qDebug() << Q_FUNC_INFO << chan << control << value;
-    fluid_synth_cc(m_synth, chan, control, value);
+    postEvent(FluidMidiEvent::Controller, chan, control, value);
 }
 
 void FluidRenderer::program(const int chan, const int program) 
 {
     //qDebug() << Q_FUNC_INFO << chan << program;
-    fluid_synth_program_change(m_synth, chan, program);
+    postEvent(FluidMidiEvent::Program, chan, 0, program);
 }
 
 void FluidRenderer::channelPressure(const int chan, const int value) 
 {
     //qDebug() << Q_FUNC_INFO << chan << value;
-    fluid_synth_channel_pressure(m_synth, chan, value);
+    postEvent(FluidMidiEvent::ChannelPressure, chan, 0, value);
 }
 
 void FluidRenderer::pitchBend(const int chan, const int value) 
 {
     //qDebug() << Q_FUNC_INFO << chan << value;
-    fluid_synth_pitch_bend(m_synth, chan, value);
+    postEvent(FluidMidiEvent::PitchBend, chan, 0, value);
 }
 
-void FluidRenderer::sysex(const QByteArray &data)
+void FluidRenderer::sysex(const QByteArray &data, const int port)
 {
     const char START_SYSEX = 0xF0;
     const char END_OF_SYSEX = 0xF7;
-    QByteArray d(data);
-    if (d.startsWith(START_SYSEX)) {
-        d.remove(0, 1);
+    const char *payload = data.constData();
+    int length = data.length();
+    if (length > 0 && payload[0] == START_SYSEX) {
+        ++payload;
+        --length;
+    }
+    if (length > 0 && payload[length - 1] == END_OF_SYSEX) {
+        --length;
     }
-    if (d.endsWith(END_OF_SYSEX)) {
-        d.chop(1);
+    const FluidMidiEvent ev = stampEvent(FluidMidiEvent::SysEx, 0, 0, length);
+    const RoutingScope scope(this);
+    if (scope.table() == nullptr) {
+        m_stats.addDroppedEvent();
+        return;
+    }
+    /* System Exclusive messages are for every channel partition of the port */
+    for (int chan = 0; chan < scope.table()->partitions; ++chan) {
+        postSysEx(scope.table()->partitionOf(port * 16 + chan), ev, payload);
     }
-    fluid_synth_sysex(m_synth, d.constData(), d.length(), nullptr, nullptr, nullptr, 0);
     //qDebug() << Q_FUNC_INFO << data.toHex();
 }
 
+/**
+ * Queues a packed buffer of raw MIDI messages, with running status, for the
+ * channels of the given port; system common and real time messages are
+ * skipped. All of them are stamped with one clock reading, so they are
+ * applied together at the start of the same block, or frameOffsets[n] frames
+ * later for the n-th channel or SysEx message when offsets are given. The
+ * offsets must be nondecreasing. Like the other producer methods, it must be
+ * called from the thread sending the MIDI events; returns the number of
+ * messages queued.
+ */
+int FluidRenderer::postMidi(const char *data, int length, const int *frameOffsets, int offsetCount, int port)
+{
+    const quint8 *bytes = reinterpret_cast<const quint8 *>(data);
+    const RoutingScope scope(this);
+    FluidMidiEvent ev;
+    ev.nsecs = m_clock.nsecsElapsed();
+    ev.reserved = 0;
+    const quint64 base = qMax(m_lastEventFrame, frameAt(ev.nsecs));
+    quint8 status = 0;
+    int messages = 0;
+    int queued = 0;
+    int i = 0;
+    while (i < length) {
+        const quint8 byte = bytes[i];
+        if (byte >= 0xF8) {
+            ++i;
+            continue;
+        }
+        const int offset = (frameOffsets != nullptr && messages < offsetCount) ? frameOffsets[messages] : 0;
+        ev.frame = qMax(m_lastEventFrame, base + qMax(offset, 0));
+        if (byte == 0xF0) {
+            int end = ++i;
+            while (end < length && bytes[end] < 0x80) {
+                ++end;
+            }
+            ev.type = FluidMidiEvent::SysEx;
+            ev.chan = 0;
+            ev.data1 = 0;
+            ev.value = end - i;
+            bool ok = (scope.table() != nullptr);
+            if (!ok) {
+                m_stats.addDroppedEvent();
+            }
+            for (int chan = 0; scope.table() != nullptr && chan < scope.table()->partitions; ++chan) {
+                ok = postSysEx(scope.table()->partitionOf(port * 16 + chan), ev, data + i) && ok;
+            }
+            queued += ok ? 1 : 0;
+            ++messages;
+            m_lastEventFrame = ev.frame;
+            status = 0;
+            i = (end < length && bytes[end] == 0xF7) ? end + 1 : end;
+            continue;
+        }
+        if (byte >= 0xF0) {
+            /* system common: MTC quarter frame, song position and song select have data */
+            status = 0;
+            i += (byte == 0xF2) ? 3 : (byte == 0xF1 || byte == 0xF3) ? 2 : 1;
+            continue;
+        }
+        if (byte & 0x80) {
+            status = byte;
+            ++i;
+        } else if (status == 0) {
+            ++i;
+            continue;
+        }
+        const int command = status & 0xF0;
+        const int size = (command == 0xC0 || command == 0xD0) ? 1 : 2;
+        if (i + size > length) {
+            break;
+        }
+        const int data1 = bytes[i] & 0x7F;
+        const int data2 = (size > 1) ? bytes[i + 1] & 0x7F : 0;
+        i += size;
+        ev.chan = static_cast<quint8>(port * 16 + (status & 0x0F));
+        ev.data1 = static_cast<quint8>(data1);
+        ev.value = data2;
+        switch (command) {
+        case 0x80:
+            ev.type = FluidMidiEvent::NoteOff;
+            ev.value = 0;
+            break;
+        case 0x90:
+            ev.type = FluidMidiEvent::NoteOn;
+            break;
+        case 0xA0:
+            ev.type = FluidMidiEvent::KeyPressure;
+            break;
+        case 0xB0:
+            ev.type = FluidMidiEvent::Controller;
+            break;
+        case 0xC0:
+            ev.type = FluidMidiEvent::Program;
+            ev.data1 = 0;
+            ev.value = data1;
+            break;
+        case 0xD0:
+            ev.type = FluidMidiEvent::ChannelPressure;
+            ev.data1 = 0;
+            ev.value = data1;
+            break;
+        default:
+            ev.type = FluidMidiEvent::PitchBend;
+            ev.data1 = 0;
+            ev.value = data1 | (data2 << 7);
+            break;
+        }
+        m_lastEventFrame = ev.frame;
+        queued += postEvent(ev) ? 1 : 0;
+        ++messages;
+    }
+    //qDebug() << Q_FUNC_INFO << messages << queued;
+    return queued;
+}
+
+/**
+ * Reads the synthesis settings. While running, the gain, chorus, reverb and
+ * a polyphony up to the initial one are applied live at the next block;
+ * returns true when the new settings need a restart to take effect.
+ */
+bool
+FluidRenderer::readSettings(QSettings *settings)
+{
+    //qDebug() << Q_FUNC_INFO;
+    settings->beginGroup(FluidDefaults::QSTR_PREFERENCES);
+    const int sampleRate = qRound(settings->value(FluidDefaults::QSTR_SAMPLERATE, FluidDefaults::DEFAULT_SAMPLERATE).toDouble());
+    m_chorus = settings->value(FluidDefaults::QSTR_CHORUS, FluidDefaults::DEFAULT_CHORUS).toInt();
+    m_reverb = settings->value(FluidDefaults::QSTR_REVERB, FluidDefaults::DEFAULT_REVERB).toInt();
+    m_gain = settings->value(FluidDefaults::QSTR_GAIN, FluidDefaults::DEFAULT_GAIN).toDouble();
+    m_polyphony = settings->value(FluidDefaults::QSTR_POLYPHONY, FluidDefaults::DEFAULT_POLYPHONY).toInt();
+    const int partitionCount = qBound(1, settings->value(FluidDefaults::QSTR_PARTITIONS, FluidDefaults::DEFAULT_PARTITIONS).toInt(), 16);
+    const int ports = qBound(1, settings->value(FluidDefaults::QSTR_PORTS, FluidDefaults::DEFAULT_PORTS).toInt(), 16);
+    const bool resample = settings->value(FluidDefaults::QSTR_RESAMPLE, FluidDefaults::DEFAULT_RESAMPLE).toBool();
+    m_governor = settings->value(FluidDefaults::QSTR_POLYPHONYGOVERNOR, FluidDefaults::DEFAULT_POLYPHONYGOVERNOR).toBool();
+    const int stems = qBound(0, settings->value(FluidDefaults::QSTR_STEMS, FluidDefaults::DEFAULT_STEMS).toInt(), 16);
+    const bool pipelinedEffects = settings->value(FluidDefaults::QSTR_PIPELINEDEFFECTS, FluidDefaults::DEFAULT_PIPELINEDEFFECTS).toBool();
+    settings->endGroup();
+    m_configuredRate = sampleRate;
+    m_resample = resample;
+    if (m_synth == nullptr) {
+        m_partitionCount = partitionCount;
+        m_ports = ports;
+        m_pipelinedEffects = pipelinedEffects;
+        setStems(stems);
+        return false;
+    }
+    if (effectiveRate(sampleRate) != m_sampleRate || partitionCount != m_partitionCount || ports != m_ports ||
+        stems != m_stems || pipelinedEffects != m_pipelinedEffects ||
+        m_polyphony >= static_cast<int>(m_voiceList.size())) {
+        m_partitionCount = partitionCount;
+        m_ports = ports;
+        m_stems = stems;
+        m_pipelinedEffects = pipelinedEffects;
+        return true;
+    }
+    publishSettings();
+    return false;
+}
+
+/* the sample rates and rendering frames are applied by the next start() */
+
+void FluidRenderer::setSampleRate(int sampleRate)
+{
+    m_configuredRate = sampleRate;
+}
+
+/* the synthesis rate, after start() */
+int FluidRenderer::sampleRate() const
+{
+    return m_sampleRate;
+}
+
+/* the sample rate setting, for opening a device before start() */
+int FluidRenderer::configuredRate() const
+{
+    return m_configuredRate;
+}
+
+/* the native rate of the audio device, or zero for the synthesis rate */
+void FluidRenderer::setOutputRate(int outputRate)
+{
+    m_outputRate = outputRate;
+}
+
+int FluidRenderer::outputRate() const
+{
+    return m_outputRate;
+}
+
+/* synthesize at the configured rate, instead of the output rate */
+void FluidRenderer::setResampling(bool enabled)
+{
+    m_resample = enabled;
+}
+
+bool FluidRenderer::resampling() const
+{
+    return m_resample;
+}
+
+void FluidRenderer::setRenderingFrames(int frames)
+{
+    m_renderingFrames = frames;
+}
+
+/* one synth per partition, each one rendering the MIDI channels chan % partitions */
+void FluidRenderer::setPartitions(int partitions)
+{
+    m_partitionCount = qBound(1, partitions, 16);
+}
+
+int FluidRenderer::partitions() const
+{
+    return m_partitionCount;
+}
+
+/* each port has its own synths and channels, see FluidRouting */
+void FluidRenderer::setPorts(int ports)
+{
+    m_ports = qBound(1, ports, 16);
+}
+
+int FluidRenderer::ports() const
+{
+    return m_ports;
+}
+
+void FluidRenderer::setGain(double gain)
+{
+    m_gain = gain;
+    publishSettings();
+}
+
+/* while running, it can't exceed the polyphony of the last start() */
+void FluidRenderer::setPolyphony(int polyphony)
+{
+    m_polyphony = polyphony;
+    publishSettings();
+}
+
+/* lower the polyphony while the rendering load is too high, see governPolyphony() */
+void FluidRenderer::setPolyphonyGovernor(bool enabled)
+{
+    m_governor = enabled;
+    publishSettings();
+}
+
+bool FluidRenderer::polyphonyGovernor() const
+{
+    return m_governor;
+}
+
+/**
+ * Governor actions of all the synths, and the lowest polyphony limit in
+ * effect among them.
+ */
+QVariantMap FluidRenderer::governorStatus() const
+{
+    quint64 reductions = m_stats.governorReductions();
+    quint64 restores = m_stats.governorRestores();
+    int polyphony = m_stats.polyphony();
+    for (FluidRenderer *partition : m_partitions) {
+        reductions += partition->stats().governorReductions();
+        restores += partition->stats().governorRestores();
+        polyphony = qMin(polyphony, partition->stats().polyphony());
+    }
+    QVariantMap result;
+    result["enabled"] = m_governor;
+    result["polyphony"] = polyphony;
+    result["reductions"] = reductions;
+    result["restores"] = restores;
+    return result;
+}
+
+/**
+ * Number of stereo stems, rendering the MIDI channels chan % stems in each
+ * one, or zero for a stereo mix; applied by the next start(). Stems are dry:
+ * the internal reverb and chorus are replaced by two send pairs.
+ */
+void FluidRenderer::setStems(int stems)
+{
+    m_stems = qBound(0, stems, 16);
+    if (m_synth == nullptr) {
+        initFormat();
+    }
+}
+
+int FluidRenderer::stems() const
+{
+    return m_stems;
+}
+
+int FluidRenderer::channels() const
+{
+    return m_channels;
+}
+
+/**
+ * Renders the stereo mix dry, and processes its reverb and chorus sends on
+ * a separate thread, in parallel with the synthesis of the next block;
+ * applied by the next start(), unless rendering stems.
+ */
+void FluidRenderer::setPipelinedEffects(bool enabled)
+{
+    m_pipelinedEffects = enabled;
+}
+
+bool FluidRenderer::pipelinedEffects() const
+{
+    return m_pipelinedEffects;
+}
+
+/* the delay of the reverb and chorus behind the dry signal, in milliseconds */
+double FluidRenderer::effectsLatency() const
+{
+    if (m_effectsThread == nullptr) {
+        return 0.0;
+    }
+    return m_renderingFrames * 1000.0 / m_sampleRate;
+}
+
+void FluidRenderer::setChorus(int chorus)
+{
+    m_chorus = chorus;
+    publishSettings();
+}
+
+void FluidRenderer::setReverb(int reverb)
+{
+    m_reverb = reverb;
+    publishSettings();
+}
+
+void FluidRenderer::publishSettings()
+{
+    m_liveGain.store(static_cast<float>(m_gain), std::memory_order_relaxed);
+    m_liveChorus.store(m_chorus, std::memory_order_relaxed);
+    m_liveReverb.store(m_reverb, std::memory_order_relaxed);
+    m_livePolyphony.store(m_polyphony, std::memory_order_relaxed);
+    m_liveGovernor.store(m_governor, std::memory_order_relaxed);
+    m_liveSerial.fetch_add(1, std::memory_order_release);
+    for (FluidRenderer *partition : m_partitions) {
+        partition->m_gain = m_gain;
+        partition->m_chorus = m_chorus;
+        partition->m_reverb = m_reverb;
+        partition->m_polyphony = m_polyphony;
+        partition->m_governor = m_governor;
+        partition->publishSettings();
+    }
+}
+
+/* runs on the audio thread, between blocks */
+void FluidRenderer::applySettings(fluid_synth_t *synth)
+{
+    m_appliedSerial = m_liveSerial.load(std::memory_order_acquire);
+    const int maxPolyphony = static_cast<int>(m_voiceList.size()) - 1;
+    fluid_synth_set_gain(synth, m_liveGain.load(std::memory_order_relaxed) * m_masterVolume);
+    fluid_synth_set_chorus_on(synth, !externalEffects() && m_liveChorus.load(std::memory_order_relaxed) > 0 ? 1 : 0);
+    fluid_synth_set_reverb_on(synth, !externalEffects() && m_liveReverb.load(std::memory_order_relaxed) > 0 ? 1 : 0);
+    if (!m_liveGovernor.load(std::memory_order_relaxed)) {
+        m_governorLimit = std::numeric_limits<int>::max();
+        forgetNotes(-1, false);
+    }
+    const int polyphony = qMin(m_livePolyphony.load(std::memory_order_relaxed), maxPolyphony);
+    fluid_synth_set_polyphony(synth, polyphony);
+    m_stats.setPolyphony(qMin(polyphony, m_governorLimit));
+}
+
+/**
+ * Runs on the audio thread after each block, including the partitions. When
+ * it took more than GOVERNOR_HIGH_LOAD percent of the real time budget, the
+ * voice limit goes down to three quarters of the sounding voices of the own
+ * synth, at most once every GOVERNOR_HOLD_TIME ms. After GOVERNOR_RESTORE_TIME
+ * ms below GOVERNOR_LOW_LOAD percent, the limit goes up again by steps. The
+ * limit applies to each synth, and shedVoices() enforces it. The polyphony of
+ * the synths is left alone: FluidLite would kill the voices above a lowered
+ * limit by their slot, regardless of what they are playing.
+ */
+void FluidRenderer::governPolyphony(qint64 nsecs, qint64 budget, int frames)
+{
+    if (!m_liveGovernor.load(std::memory_order_relaxed) || budget <= 0) {
+        return;
+    }
+    const int maxPolyphony = static_cast<int>(m_voiceList.size()) - 1;
+    const int polyphony = qMin(m_livePolyphony.load(std::memory_order_relaxed), maxPolyphony);
+    const int limit = qMin(polyphony, m_governorLimit);
+    const qint64 load = nsecs * 100 / budget;
+    m_governorHeld += frames;
+    m_governorQuiet = (load < FluidDefaults::GOVERNOR_LOW_LOAD) ? m_governorQuiet + frames : 0;
+    if (load > FluidDefaults::GOVERNOR_HIGH_LOAD &&
+        m_governorHeld * 1000 >= qint64(FluidDefaults::GOVERNOR_HOLD_TIME) * m_sampleRate) {
+        const int reduced = qMax(FluidDefaults::GOVERNOR_MIN_POLYPHONY, qMin(limit, voiceCount(m_synth)) * 3 / 4);
+        if (reduced < limit) {
+            m_governorLimit = reduced;
+            m_governorHeld = 0;
+            m_stats.addGovernorAction(true, reduced);
+        }
+    } else if (limit < polyphony &&
+               m_governorQuiet * 1000 >= qint64(FluidDefaults::GOVERNOR_RESTORE_TIME) * m_sampleRate) {
+        const int raised = qMin(polyphony, limit + qMax(limit / 4, 1));
+        m_governorLimit = (raised < polyphony) ? raised : std::numeric_limits<int>::max();
+        m_governorQuiet = 0;
+        m_stats.addGovernorAction(false, raised);
+    }
+    /* read by the partition threads after the next post */
+    for (FluidRenderer *partition : m_partitions) {
+        partition->m_governorLimit = m_governorLimit;
+    }
+}
+
+/**
+ * Runs on the audio thread after rendering the own synth of each block. The
+ * voices over the governor limit are released with the shortest envelope:
+ * the released ones first, then those of the softest and oldest held notes.
+ * FluidLite has no public access to the amplitude of a voice, so the note
+ * velocity stands for it.
+ */
+void FluidRenderer::shedVoices()
+{
+    if (m_governorLimit == std::numeric_limits<int>::max()) {
+        return;
+    }
+    const int count = voiceCount(m_synth);
+    const int excess = count - m_governorLimit;
+    if (excess <= 0) {
+        return;
+    }
+    m_shedList.clear();
+    for (int i = 0; i < count; ++i) {
+        const unsigned int id = fluid_voice_get_id(m_voiceList[i]);
+        quint64 rank = id;
+        const HeldNote *note = heldNote(id);
+        if (note != nullptr) {
+            rank |= Q_UINT64_C(1) << 40 | quint64(note->velocity) << 32;
+        }
+        m_shedList.emplace_back(rank, m_voiceList[i]);
+    }
+    std::nth_element(m_shedList.begin(), m_shedList.begin() + excess, m_shedList.end(),
+                     [](const std::pair<quint64, fluid_voice_t *> &a, const std::pair<quint64, fluid_voice_t *> &b) {
+                         return a.first < b.first;
+                     });
+    for (int i = 0; i < excess; ++i) {
+        fluid_voice_t *voice = m_shedList[i].second;
+        fluid_voice_gen_set(voice, GEN_VOLENVRELEASE, FluidDefaults::GOVERNOR_RELEASE);
+        fluid_voice_update_param(voice, GEN_VOLENVRELEASE);
+        if ((m_shedList[i].first >> 40) != 0) {
+            const unsigned int id = static_cast<unsigned int>(m_shedList[i].first);
+            const HeldNote *note = heldNote(id);
+            if (note != nullptr) {
+                forgetNote(note->chan * 128 + note->key);
+            }
+            /* the other voices of the note are released normally */
+            fluid_synth_stop(m_synth, id);
+        }
+    }
+}
+
+/**
+ * The held notes are tracked while the governor is enabled, to tell the
+ * released voices from the others. All the voices started by a note share
+ * its id, the newest one.
+ */
+void FluidRenderer::trackNoteOn(int chan, int key, int vel)
+{
+    const size_t slot = static_cast<size_t>(chan) * 128 + key;
+    if (!m_liveGovernor.load(std::memory_order_relaxed) || chan < 0 || slot >= m_noteIds.size()) {
+        return;
+    }
+    forgetNote(slot);
+    unsigned int id = 0;
+    const int count = voiceCount(m_synth);
+    for (int i = 0; i < count; ++i) {
+        id = qMax(id, fluid_voice_get_id(m_voiceList[i]));
+    }
+    /* unless it started no voices, without a preset for the note */
+    if (id > m_lastNoteId) {
+        m_lastNoteId = id;
+        m_noteIds[slot] = id;
+        HeldNote note { id, static_cast<quint8>(chan), static_cast<quint8>(key), static_cast<quint8>(vel), false };
+        m_heldNotes.push_back(note);
+    }
+}
+
+void FluidRenderer::trackNoteOff(int chan, int key)
+{
+    const size_t slot = static_cast<size_t>(chan) * 128 + key;
+    if (chan < 0 || slot >= m_noteIds.size() || m_noteIds[slot] == 0) {
+        return;
+    }
+    if (!m_sustain[chan]) {
+        forgetNote(slot);
+        return;
+    }
+    HeldNote *note = heldNote(m_noteIds[slot]);
+    if (note != nullptr) {
+        note->sustained = true;
+    }
+}
+
+void FluidRenderer::forgetNote(size_t slot)
+{
+    const unsigned int id = m_noteIds[slot];
+    if (id == 0) {
+        return;
+    }
+    m_noteIds[slot] = 0;
+    HeldNote *note = heldNote(id);
+    if (note != nullptr) {
+        m_heldNotes.erase(m_heldNotes.begin() + (note - m_heldNotes.data()));
+    }
+}
+
+FluidRenderer::HeldNote *FluidRenderer::heldNote(unsigned int id)
+{
+    auto note = std::lower_bound(m_heldNotes.begin(), m_heldNotes.end(), id,
+                                 [](const HeldNote &held, unsigned int value) { return held.id < value; });
+    return (note != m_heldNotes.end() && note->id == id) ? &*note : nullptr;
+}
+
+/* the notes of a channel, or of all with chan < 0; keeps the order, without allocations */
+void FluidRenderer::forgetNotes(int chan, bool sustainedOnly)
+{
+    auto released = [this, chan, sustainedOnly](const HeldNote &note) {
+        if ((chan >= 0 && note.chan != chan) || (sustainedOnly && !note.sustained)) {
+            return false;
+        }
+        m_noteIds[note.chan * 128 + note.key] = 0;
+        return true;
+    };
+    m_heldNotes.erase(std::remove_if(m_heldNotes.begin(), m_heldNotes.end(), released), m_heldNotes.end());
+}
+
+/* only meaningful when called from the rendering thread, see stats() otherwise */
+int FluidRenderer::activeVoiceCount() const
+{
+    int count = voiceCount(m_synth);
+    for (FluidRenderer *partition : m_partitions) {
+        count += partition->activeVoiceCount();
+    }
+    return count;
+}
+
+int FluidRenderer::voiceCount(fluid_synth_t *synth) const
+{
+    if (synth == nullptr || m_voiceList.empty()) {
+        return 0;
+    }
+    const int size = static_cast<int>(m_voiceList.size());
+    fluid_synth_get_voicelist(synth, m_voiceList.data(), size, -1);
+    int count = 0;
+    while (count < size && m_voiceList[count] != nullptr) {
+        ++count;
+    }
+    return count;
+}
+
 void
 FluidRenderer::initReverb(int reverb_type)
 {
@@ -263,14 +1765,14 @@ FluidRenderer::initReverb(int reverb_type)
         fluid_synth_set_reverb(m_synth, 1.0, 0.2, 0.75, 0.8);
         break;
     };
-    fluid_synth_set_reverb_on(m_synth, reverb_type > 0 ? 1 : 0);
+    fluid_synth_set_reverb_on(m_synth, reverb_type > 0 && !externalEffects() ? 1 : 0);
 }
 
 void
 FluidRenderer::initChorus(int chorus_type)
 {
     //qDebug() << Q_FUNC_INFO << chorus_type;
-    fluid_synth_set_chorus_on(m_synth, chorus_type > 0 ? 1 : 0);
+    fluid_synth_set_chorus_on(m_synth, chorus_type > 0 && !externalEffects() ? 1 : 0);
 }
 
 void
@@ -302,15 +1804,157 @@ FluidRenderer::setChorusLevel(int amount)
     }
 }
 
+/**
+ * Before start(), only remembers the file name. While running, the SoundFont
+ * is loaded on a worker thread and swapped in at a block boundary; the old
+ * one keeps playing until then, and its sounding notes are released.
+ */
 void
 FluidRenderer::setSoundFont(const QString& fileName)
 {
     //qDebug() << Q_FUNC_INFO << fileName;
-    m_soundFont = fileName;
-    if (m_synth != nullptr) {
-        auto result = fluid_synth_sfload(m_synth, fileName.toLocal8Bit(), 1);
-        m_sf2loaded = result != -1;
-        m_sfid = result;
+    for (FluidRenderer *partition : m_partitions) {
+        partition->setSoundFont(fileName);
+    }
+    if (m_synth == nullptr) {
+        m_soundFont = fileName;
+    } else if (m_loader != nullptr) {
+        m_nextSoundFont = fileName;
+    } else {
+        startLoader(fileName);
+    }
+}
+
+void FluidRenderer::startLoader(const QString &fileName)
+{
+    FluidSoundFontLoader *loader = new FluidSoundFontLoader(this, fileName);
+    connect(loader, &FluidSoundFontLoader::swapped, this, [=]{
+        if (loader == m_loader) {
+            m_soundFont = loader->fileName();
+            m_sfid = m_pendingSfid;
+            m_sf2loaded = true;
+            m_status = true;
+            emit soundFontLoaded(m_soundFont, true);
+        }
+    }, Qt::QueuedConnection);
+    connect(loader, &QThread::finished, this, [=]{
+        if (loader == m_loader) {
+            loaderFinished();
+        }
+    }, Qt::QueuedConnection);
+    m_loader = loader;
+    emit soundFontLoading(fileName);
+    m_loader->start(QThread::LowPriority);
+}
+
+void FluidRenderer::loaderFinished()
+{
+    m_loader->wait();
+    if (!m_loader->succeeded()) {
+        emit soundFontLoaded(m_loader->fileName(), false);
+    }
+    delete m_loader;
+    m_loader = nullptr;
+    if (!m_nextSoundFont.isEmpty()) {
+        startLoader(m_nextSoundFont);
+        m_nextSoundFont.clear();
+    }
+}
+
+void FluidRenderer::stopLoader()
+{
+    if (m_loader != nullptr) {
+        m_loader->requestInterruption();
+        m_loader->wait();
+        delete m_loader;
+        m_loader = nullptr;
+    }
+    m_nextSoundFont.clear();
+    /* rendering has stopped, so whatever is left in the handoff can go */
+    fluid_synth_t *synth = m_pendingSynth.exchange(nullptr);
+    if (synth != nullptr) {
+        deleteSynth(synth);
+    }
+    synth = m_retiredSynth.exchange(nullptr);
+    if (synth != nullptr) {
+        deleteSynth(synth);
+    }
+    if (m_retiringSynth != nullptr) {
+        deleteSynth(m_retiringSynth);
+        m_retiringSynth = nullptr;
+    }
+}
+
+/* the SoundFonts may be shared with other synths, see FluidSoundFontCache */
+void FluidRenderer::deleteSynth(fluid_synth_t *synth)
+{
+    FluidSoundFontCache::instance()->detach(synth);
+    delete_fluid_synth(synth);
+}
+
+/**
+ * Runs on the audio thread: the staging synth takes over the channel state,
+ * and the replaced one is kept rendering to let its notes release.
+ */
+void FluidRenderer::swapSynth()
+{
+    /* bank select and the (N)RPN numbers go first; data entry and
+       increment/decrement are not replayed, as they would apply the stored
+       values to whatever parameter the staging synth has selected */
+    static const int leadingControllers[] = { 0, 32, 98, 99, 100, 101 };
+    fluid_synth_t *synth = m_pendingSynth.load(std::memory_order_acquire);
+    const int channels = fluid_synth_count_midi_channels(m_synth);
+    for (int chan = 0; chan < channels; ++chan) {
+        for (int ctl : leadingControllers) {
+            copyController(synth, chan, ctl);
+        }
+        unsigned int sfont = 0, bank = 0, preset = 0;
+        fluid_synth_get_program(m_synth, chan, &sfont, &bank, &preset);
+        fluid_synth_bank_select(synth, chan, bank);
+        fluid_synth_program_change(synth, chan, preset);
+        for (int ctl = 0; ctl < 120; ++ctl) {
+            switch (ctl) {
+            case 0: case 32:
+            case 6: case 38: case 96: case 97:
+            case 98: case 99: case 100: case 101:
+                break;
+            default:
+                copyController(synth, chan, ctl);
+            }
+        }
+        int bend = 0;
+        fluid_synth_get_pitch_bend(m_synth, chan, &bend);
+        fluid_synth_pitch_bend(synth, chan, bend);
+        /* all notes off */
+        fluid_synth_cc(m_synth, chan, 123, 0);
+    }
+    /* the staging synth was created with the settings of the last start() */
+    forgetNotes(-1, false);
+    m_lastNoteId = 0;
+    applySettings(synth);
+    m_retiringSynth = m_synth;
+    m_retiringFrames = 0;
+    m_synth = synth;
+    m_pendingSynth.store(nullptr, std::memory_order_release);
+}
+
+void FluidRenderer::copyController(fluid_synth_t *synth, int chan, int ctl)
+{
+    int value = 0, current = 0;
+    fluid_synth_get_cc(m_synth, chan, ctl, &value);
+    fluid_synth_get_cc(synth, chan, ctl, &current);
+    if (value != current) {
+        fluid_synth_cc(synth, chan, ctl, value);
+    }
+}
+
+void FluidRenderer::retireSynth(int frames)
+{
+    const qint64 maxFrames = FluidDefaults::SOUNDFONT_RELEASE_TIME * m_sampleRate / 1000;
+    m_retiringFrames += frames;
+    if (m_retiringFrames >= maxFrames || voiceCount(m_retiringSynth) == 0) {
+        m_retiredSynth.store(m_retiringSynth, std::memory_order_release);
+        m_retiringSynth = nullptr;
     }
 }
 
@@ -324,27 +1968,157 @@ void FluidRenderer::resetLastBufferSize()
     m_lastBufferSize = 0;
 }
 
+const FluidRenderStats&
+FluidRenderer::stats() const
+{
+    return m_stats;
+}
+
+/* the rate of the frames read from the device: the output rate, or the synthesis rate */
+int FluidRenderer::frameRate() const
+{
+    return (m_offline || m_outputRate <= 0) ? m_sampleRate : m_outputRate;
+}
+
+int FluidRenderer::renderingFrames() const
+{
+    return m_renderingFrames;
+}
+
+/**
+ * Sets the sample format of the frames read from the device, after start().
+ * Must not be called while a sink reads data.
+ */
+void FluidRenderer::setOutputSampleFormat(FluidSampleConverter::Format sampleFormat)
+{
+    m_sampleFormat = sampleFormat;
+    m_sampleBytes = FluidSampleConverter::sampleBytes(sampleFormat);
+    const QString conversion = (sampleFormat == FluidSampleConverter::Float) ? tr("no conversion") :
+        tr("%1 conversion").arg(FluidSampleConverter::instructionSet());
+    appendDiagnostics(fluid_log_level::FLUID_INFO,
+        qPrintable(tr("Audio output format: %1 (%2)").arg(FluidSampleConverter::formatName(sampleFormat), conversion)));
+}
+
+FluidSampleConverter::Format FluidRenderer::outputSampleFormat() const
+{
+    return m_sampleFormat;
+}
+
+#ifndef FLUID_HEADLESS
 const QAudioFormat&
 FluidRenderer::format() const
 {
     return m_format;
 }
 
+/**
+ * Sets the format negotiated with the audio device, with the sample rate
+ * and channels of format(). Must not be called while a sink reads data.
+ */
+void FluidRenderer::setOutputFormat(const QAudioFormat &format)
+{
+    FluidSampleConverter::Format sampleFormat;
+    if (!FluidRenderer::sampleFormat(format, sampleFormat)) {
+        return;
+    }
+    m_format = format;
+    setOutputSampleFormat(sampleFormat);
+}
+
+/* returns false for the sample formats that can't be rendered */
+bool FluidRenderer::sampleFormat(const QAudioFormat &format, FluidSampleConverter::Format &sampleFormat)
+{
+#if QT_VERSION < QT_VERSION_CHECK(6,0,0)
+    /* the samples are rendered and converted in the host byte order */
+    if (format.byteOrder() != static_cast<QAudioFormat::Endian>(QSysInfo::ByteOrder)) {
+        return false;
+    }
+    if (format.sampleType() == QAudioFormat::Float && format.sampleSize() == 32) {
+        sampleFormat = FluidSampleConverter::Float;
+    } else if (format.sampleType() == QAudioFormat::SignedInt && format.sampleSize() == 16) {
+        sampleFormat = FluidSampleConverter::Int16;
+    } else if (format.sampleType() == QAudioFormat::SignedInt && format.sampleSize() == 24) {
+        sampleFormat = FluidSampleConverter::Int24;
+    } else if (format.sampleType() == QAudioFormat::SignedInt && format.sampleSize() == 32) {
+        sampleFormat = FluidSampleConverter::Int32;
+    } else {
+        return false;
+    }
+#else
+    switch (format.sampleFormat()) {
+    case QAudioFormat::Float:
+        sampleFormat = FluidSampleConverter::Float;
+        break;
+    case QAudioFormat::Int16:
+        sampleFormat = FluidSampleConverter::Int16;
+        break;
+    case QAudioFormat::Int32:
+        sampleFormat = FluidSampleConverter::Int32;
+        break;
+    default:
+        return false;
+    }
+#endif
+    return true;
+}
+
+/* Qt6 has no 24 bit format, Int32 is used instead */
+void FluidRenderer::setSampleFormat(QAudioFormat &format, FluidSampleConverter::Format sampleFormat)
+{
+#if QT_VERSION < QT_VERSION_CHECK(6,0,0)
+    format.setSampleType(sampleFormat == FluidSampleConverter::Float ? QAudioFormat::Float : QAudioFormat::SignedInt);
+    format.setSampleSize(FluidSampleConverter::sampleBytes(sampleFormat) * CHAR_BIT);
+#else
+    switch (sampleFormat) {
+    case FluidSampleConverter::Int16:
+        format.setSampleFormat(QAudioFormat::Int16);
+        break;
+    case FluidSampleConverter::Int24:
+    case FluidSampleConverter::Int32:
+        format.setSampleFormat(QAudioFormat::Int32);
+        break;
+    case FluidSampleConverter::Float:
+    default:
+        format.setSampleFormat(QAudioFormat::Float);
+        break;
+    }
+#endif
+}
+#endif
+
+/* safe to call from any thread, also from the FluidLite log function while rendering */
 void FluidRenderer::appendDiagnostics(int level, const char *message)
 {
-    static const QMap<int,QString> prefix {
-        {fluid_log_level::FLUID_DBG,  tr("Debug")},
-        {fluid_log_level::FLUID_ERR,  tr("Error")},
-        {fluid_log_level::FLUID_WARN, tr("Warning")},
-        {fluid_log_level::FLUID_INFO, tr("Information")}
-    };
-    m_diagnostics.append(prefix[level]+": "+message);
-    //qDebug() << Q_FUNC_INFO << prefix[level] << ": " << message;
+    m_diagnostics.append(level, message);
+    //qDebug() << Q_FUNC_INFO << level << ": " << message;
 }
 
 QStringList FluidRenderer::getDiagnostics()
 {
-    return m_diagnostics;
+    QStringList result;
+    const quint64 discarded = m_diagnostics.discarded();
+    if (discarded > 0) {
+        result.append(tr("%1 older messages discarded").arg(discarded));
+    }
+    foreach(const FluidDiagnosticsLog::Entry &entry, m_diagnostics.entries()) {
+        QString prefix;
+        switch (entry.level) {
+        case fluid_log_level::FLUID_DBG:
+            prefix = tr("Debug");
+            break;
+        case fluid_log_level::FLUID_ERR:
+            prefix = tr("Error");
+            break;
+        case fluid_log_level::FLUID_WARN:
+            prefix = tr("Warning");
+            break;
+        default:
+            prefix = tr("Information");
+            break;
+        }
+        result.append(prefix + ": " + entry.text);
+    }
+    return result;
 }
 
 QString FluidRenderer::getLibVersion()
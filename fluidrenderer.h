@@ -22,9 +22,71 @@
 #include <QObject>
 #include <QIODevice>
 #include <QScopedPointer>
+#ifndef FLUID_HEADLESS
 #include <QAudioFormat>
+#endif
+#include <QElapsedTimer>
+#include <QSettings>
+#include <atomic>
+#include <utility>
+#include <vector>
 #include <fluidlite.h>
 
+#include "fluiddiagnostics.h"
+#include "fluideffects.h"
+#include "fluidresampler.h"
+#include "fluidringbuffer.h"
+#include "fluidsampleconvert.h"
+#include "fluidstatistics.h"
+
+class FluidRenderer;
+class FluidRenderThread;
+class FluidPartitionThread;
+class FluidEffectsThread;
+class FluidAudioFileWriter;
+class FluidSoundFontLoader;
+
+struct FluidMidiEvent
+{
+    enum Type : quint8 {
+        NoteOff,
+        NoteOn,
+        KeyPressure,
+        Controller,
+        Program,
+        ChannelPressure,
+        PitchBend,
+        SysEx
+    };
+    quint64 frame; // renderer frame time when the event is due
+    qint64 nsecs;  // arrival time, stamped by postEvent()
+    quint8 type;
+    quint8 chan;
+    quint8 data1;
+    quint8 reserved;
+    qint32 value; // data2, pitch bend value, or SysEx payload length
+};
+
+/**
+ * The synths receiving the events of each port, as started. Each port has
+ * its own 16 MIDI channels, split across its partitions: channel
+ * 16 * port + chan goes to the synth of partition chan % partitions of that
+ * port, as channel chan. A table is immutable once published, and deleted
+ * only after the MIDI thread has left it.
+ */
+struct FluidRouting
+{
+    int ports;
+    int partitions;
+    std::vector<FluidRenderer *> renderers; // ports * partitions, the parent first
+
+    FluidRenderer *partitionOf(int chan) const
+    {
+        const int port = (chan / 16) % ports;
+        return renderers[port * partitions + (chan % 16) % partitions];
+    }
+};
+
 class FluidRenderer : public QIODevice
 {
     Q_OBJECT
@@ -55,6 +117,33 @@ public:
     bool getStatus();
 
     /* FluidLite */
+    bool readSettings(QSettings *settings);
+    void setSampleRate(int sampleRate);
+    int sampleRate() const;
+    int configuredRate() const;
+    void setOutputRate(int outputRate);
+    int outputRate() const;
+    void setResampling(bool enabled);
+    bool resampling() const;
+    void setRenderingFrames(int frames);
+    void setGain(double gain);
+    void setPolyphony(int polyphony);
+    void setPolyphonyGovernor(bool enabled);
+    bool polyphonyGovernor() const;
+    QVariantMap governorStatus() const;
+    void setChorus(int chorus);
+    void setReverb(int reverb);
+    void setPartitions(int partitions);
+    int partitions() const;
+    void setPorts(int ports);
+    int ports() const;
+    void setStems(int stems);
+    int stems() const;
+    int channels() const;
+    void setPipelinedEffects(bool enabled);
+    bool pipelinedEffects() const;
+    double effectsLatency() const;
+    int activeVoiceCount() const;
     void initReverb(int reverb_type);
     void initChorus(int chorus_type);
     void setReverbLevel(int amount);
@@ -62,11 +151,49 @@ public:
     QString soundFont() const { return m_soundFont; }
     void setSoundFont(const QString &fileName);
 
-    /* Qt Multimedia */
-    const QAudioFormat &format() const;
+    /* Event scheduling */
+    quint64 currentFrame() const;
+    quint64 deliveredFrames() const;
+    bool postEvent(FluidMidiEvent ev);
+    bool idle() const;
+    void setSuspended(bool suspended);
+    bool suspended() const;
+    int postMidi(const char *data, int length, const int *frameOffsets = nullptr, int offsetCount = 0, int port = 0);
+
+    /* Render thread */
+    void setRenderThread(bool enabled, int ringTime, int maxRingTime);
+    void setRingTime(int ringTime);
+    int maxRingTime() const;
+    bool renderThread() const;
+    int ringFillLevel() const;
+    int renderAhead();
+    unsigned long blockDuration() const;
+
+    /* Offline rendering */
+    void setOffline(bool enabled);
+    bool offline() const;
+    qint64 renderOffline(FluidAudioFileWriter *writer, qint64 frames);
+
+    /* Performance counters */
+    const FluidRenderStats &stats() const;
+    void updateOutputLatency(quint64 consumedFrames);
+
+    /* Output format */
+    int frameRate() const;
+    int renderingFrames() const;
+    void setOutputSampleFormat(FluidSampleConverter::Format sampleFormat);
+    FluidSampleConverter::Format outputSampleFormat() const;
     qint64 lastBufferSize() const;
     void resetLastBufferSize();
 
+#ifndef FLUID_HEADLESS
+    /* Qt Multimedia */
+    const QAudioFormat &format() const;
+    void setOutputFormat(const QAudioFormat &format);
+    static bool sampleFormat(const QAudioFormat &format, FluidSampleConverter::Format &sampleFormat);
+    static void setSampleFormat(QAudioFormat &format, FluidSampleConverter::Format sampleFormat);
+#endif
+
 public slots:
     void noteOn(const int chan, const int note, const int vel);
     void noteOff(const int chan, const int note, const int vel);
@@ -75,36 +202,218 @@ public slots:
     void program(const int chan, const int program);
     void channelPressure(const int chan, const int value);
     void pitchBend(const int chan, const int value);
-    void sysex(const QByteArray &data);
+    void sysex(const QByteArray &data, const int port = 0);
+
+signals:
+    void soundFontLoading(const QString &fileName);
+    void soundFontLoaded(const QString &fileName, bool ok);
+    void wakeRequested();
 
 private:
     void initialize();
     void uninitialize();
+    void postEvent(quint8 type, int chan, int data1, int value);
+    FluidMidiEvent stampEvent(quint8 type, int chan, int data1, int value);
+    bool postSysEx(FluidRenderer *target, const FluidMidiEvent &ev, const char *payload);
+    void processEvent(const FluidMidiEvent &ev);
+    void processSysEx(const char *data, int length);
+    void publishClock(quint64 cycleEnd);
+    void setLogFunction();
+    void startPartitions();
+    void stopPartitions();
+    void publishSettings();
+    void applySettings(fluid_synth_t *synth);
+    void governPolyphony(qint64 nsecs, qint64 budget, int frames);
+    void shedVoices();
+    void trackNoteOn(int chan, int key, int vel);
+    void trackNoteOff(int chan, int key);
+    void forgetNote(size_t slot);
+    void forgetNotes(int chan, bool sustainedOnly);
+    void detectSilence(const float *buffer, int frames);
+    void wake();
+    void startLoader(const QString &fileName);
+    void loaderFinished();
+    void stopLoader();
+    void swapSynth();
+    void copyController(fluid_synth_t *synth, int chan, int ctl);
+    void retireSynth(int frames);
+    int voiceCount(fluid_synth_t *synth) const;
+    static void deleteSynth(fluid_synth_t *synth);
+    quint64 frameAt(qint64 nsecs) const;
+    void initFormat();
+    void renderOutput(float *buffer, int frames);
+    int audioGroups() const;
+    bool externalEffects() const;
+    void initStems();
+    void writeSynth(fluid_synth_t *synth, int frames, float *buffer, float *sends);
+    void updateEffects();
+    void processEffects(float *buffer, int frames);
+    quint64 synthFrames(qint64 outputFrames) const;
+    quint64 ringSynthFrames(qint64 outputFrames);
+    int effectiveRate(int configuredRate) const;
+    int render(float *buffer, int frames);
 
 private:
     friend class FluidController;
-    QStringList m_diagnostics;
+    friend class FluidSoundFontLoader;
+    friend class FluidPartitionThread;
+    FluidDiagnosticsLog m_diagnostics;
     QString m_runtimeLibraryVersion;
     bool m_status;
 
     /* FluidLite */
-    int m_sampleRate;
+    int m_sampleRate; // of the synthesis
+    int m_configuredRate;
+    int m_outputRate;
+    bool m_resample;
+    FluidResampler m_resampler;
+    std::vector<float> m_resampleBuffer;
     int m_renderingFrames;
     int m_channels;
-    int m_sample_size;
     double m_gain;
     int m_chorus;
     int m_reverb;
     int m_polyphony;
+    int m_stems; // stereo stems, or zero for the stereo mix
+    std::vector<float> m_stemBuffer;
+    std::vector<float *> m_stemLeft;
+    std::vector<float *> m_stemRight;
+    /* reverb and chorus of the stereo mix, processed from its sends by
+       m_effects on the effects thread, one block behind */
+    bool m_pipelinedEffects;
+    bool m_partition; // its sends are processed by the renderer driving it
+    FluidEffects m_effects;
+    FluidEffectsThread *m_effectsThread;
+    bool m_effectsPending; // owned by the audio thread
+    std::vector<float> m_sendBuffer;
+    std::vector<float> m_retiringSends;
     fluid_settings_t *m_settings;
     fluid_synth_t *m_synth;
     bool m_sf2loaded;
     QString m_soundFont;
     int m_sfid;
 
-    /* Qt Multimedia */
+    /* live settings, published by the controller and applied by the audio thread */
+    std::atomic<float> m_liveGain;
+    std::atomic<int> m_liveChorus;
+    std::atomic<int> m_liveReverb;
+    std::atomic<int> m_livePolyphony;
+    std::atomic<bool> m_liveGovernor;
+    std::atomic<quint32> m_liveSerial;
+    quint32 m_appliedSerial;
+
+    /* polyphony governor, the state is owned by the audio thread */
+    bool m_governor;
+    int m_governorLimit;
+    qint64 m_governorHeld; // frames since the last reduction
+    qint64 m_governorQuiet; // frames under the low load threshold
+    struct HeldNote {
+        unsigned int id; // of the voices started by the note
+        quint8 chan;
+        quint8 key;
+        quint8 velocity;
+        bool sustained; // released while the sustain pedal was down
+    };
+    HeldNote *heldNote(unsigned int id);
+    std::vector<HeldNote> m_heldNotes; // sorted by id, the older first
+    std::vector<unsigned int> m_noteIds; // of the held notes, by chan * 128 + key
+    std::vector<bool> m_sustain; // pedal down, by chan
+    unsigned int m_lastNoteId;
+    std::vector<std::pair<quint64, fluid_voice_t *>> m_shedList; // rank and voice
+    float m_masterVolume; // universal SysEx, owned by the audio thread
+
+    /* idle detection, and the audio sink suspended by the controller */
+    bool m_silent; // skipping synthesis, owned by the audio thread
+    std::atomic<bool> m_idle;
+    std::atomic<bool> m_suspended;
+    std::atomic<bool> m_wakeRequested;
+    std::atomic<qint64> m_resumeNsecs;
+
+    /* MIDI thread to audio thread handoff */
+    FluidRingBuffer<FluidMidiEvent> m_events;
+    FluidRingBuffer<char> m_sysexData;
+    std::vector<char> m_sysexBuffer;
+
+    /* frame clock, written by the audio thread and read by event producers */
+    QElapsedTimer m_clock;
+    quint64 m_frameTime;
+    quint64 m_lastEventFrame; // producer side
+    std::atomic<quint32> m_clockSeq;
+    std::atomic<quint64> m_cycleFrame;
+    std::atomic<qint64> m_cycleNsecs;
+    std::atomic<quint64> m_deliveredFrames; // handed to the audio sink
+    qint64 m_deliveredRemainder; // of the rate conversion, carried to the next read
+
+    /* render thread, rendering ahead into m_audioRing */
+    bool m_threaded;
+    int m_ringTime;
+    int m_maxRingTime; // the ring capacity, m_ringTime may change up to it
+    std::atomic<size_t> m_ringLimit; // samples the render thread keeps ahead
+    FluidRenderThread *m_renderThread;
+    FluidRingBuffer<float> m_audioRing;
+    std::vector<float> m_renderBuffer;
+
+    /* the channels of each port are partitioned by chan % m_partitionCount;
+       partition 0 of port 0 is rendered by m_synth, and the others by child
+       renderers in parallel */
+    int m_partitionCount;
+    int m_ports;
+    std::vector<FluidRenderer *> m_partitions;
+    std::vector<FluidPartitionThread *> m_partitionThreads;
+    std::atomic<const FluidRouting *> m_routing; // null while stopped
+    std::atomic<int> m_routingUsers;
+
+    /* the routing table in use by the MIDI thread, for the scope of an event */
+    class RoutingScope
+    {
+    public:
+        explicit RoutingScope(FluidRenderer *renderer) : m_renderer(renderer)
+        {
+            m_renderer->m_routingUsers.fetch_add(1);
+            m_table = m_renderer->m_routing.load();
+        }
+        ~RoutingScope()
+        {
+            m_renderer->m_routingUsers.fetch_sub(1, std::memory_order_release);
+        }
+        const FluidRouting *table() const
+        {
+            return m_table;
+        }
+    private:
+        FluidRenderer *m_renderer;
+        const FluidRouting *m_table;
+    };
+
+    /* offline rendering, without wall clock */
+    bool m_offline;
+
+    /* asynchronous SoundFont loading into a staging synth */
+    FluidSoundFontLoader *m_loader;
+    QString m_nextSoundFont;
+    std::atomic<fluid_synth_t *> m_pendingSynth; // loaded, waiting for the audio thread
+    std::atomic<fluid_synth_t *> m_retiredSynth; // released, waiting for deletion
+    int m_pendingSfid;
+    fluid_synth_t *m_retiringSynth; // replaced, still rendering its release tail
+    qint64 m_retiringFrames;
+    std::vector<float> m_retiringBuffer;
+
+    FluidRenderStats m_stats;
+    struct LatencyProbe {
+        quint64 frame;
+        qint64 nsecs;
+    };
+    FluidRingBuffer<LatencyProbe> m_latencyProbes;
+    mutable std::vector<fluid_voice_t *> m_voiceList;
+
+    /* output format */
     int m_lastBufferSize;
+#ifndef FLUID_HEADLESS
     QAudioFormat m_format;
+#endif
+    FluidSampleConverter::Format m_sampleFormat;
+    int m_sampleBytes;
+    std::vector<float> m_convertBuffer; // float block before the conversion
 };
 
 #endif /*FLUIDRENDERER_H_*/
@@ -0,0 +1,207 @@
+/*
+    Drumstick RT (realtime MIDI In/Out) FluidLite Backend
+    Copyright (C) 2022, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+
+#include "fluideffects.h"
+#include "fluidrenderer.h"
+#include "fluidrenderthread.h"
+
+FluidRenderThread::FluidRenderThread(FluidRenderer *renderer, QObject *parent):
+    QThread(parent),
+    m_renderer(renderer)
+{
+    //qDebug() << Q_FUNC_INFO;
+}
+
+void FluidRenderThread::run()
+{
+    //qDebug() << Q_FUNC_INFO;
+    const unsigned long blockTime = m_renderer->blockDuration();
+    while (!isInterruptionRequested()) {
+        if (m_renderer->renderAhead() == 0) {
+            /* the ring is full, wait until the sink consumes about one block */
+            QThread::usleep(blockTime);
+        }
+    }
+}
+
+/* polls of the audio thread before doing a block itself, a few microseconds */
+static const int FINISH_SPINS = 4096;
+/* polls of an idle worker before it parks */
+static const int IDLE_SPINS = 1024;
+
+FluidBlockWorker::FluidBlockWorker(QObject *parent):
+    QThread(parent),
+    m_posted(0),
+    m_taken(0),
+    m_done(0),
+    m_stopping(false),
+    m_parked(false)
+{
+    //qDebug() << Q_FUNC_INFO;
+}
+
+void FluidBlockWorker::stop()
+{
+    //qDebug() << Q_FUNC_INFO;
+    m_stopping.store(true);
+    wakeUp();
+    wait();
+}
+
+/* the semaphore is only touched when the worker is parked */
+void FluidBlockWorker::wakeUp()
+{
+    if (m_parked.exchange(false)) {
+        m_wakeup.release();
+    }
+}
+
+/* audio thread: the data of the block must be in place before */
+void FluidBlockWorker::post()
+{
+    m_posted.store(m_posted.load(std::memory_order_relaxed) + 1);
+    wakeUp();
+}
+
+/**
+ * Worker thread: waits for wakeUp(), unless there is something to do after
+ * all. Either the waker clears m_parked and releases the semaphore once,
+ * or the worker clears it itself and doesn't wait.
+ */
+void FluidBlockWorker::park()
+{
+    m_parked.store(true);
+    if (m_posted.load() != m_taken.load() || m_stopping.load()) {
+        if (m_parked.exchange(false)) {
+            return;
+        }
+    }
+    m_wakeup.acquire();
+}
+
+/* whoever claims a block does its work, the other one leaves it alone */
+bool FluidBlockWorker::claim(quint32 block)
+{
+    quint32 previous = block - 1;
+    return m_taken.compare_exchange_strong(previous, block, std::memory_order_acq_rel);
+}
+
+/**
+ * Audio thread: returns once the last posted block is done. Only a block
+ * the worker is already working on is waited for without a bound.
+ */
+void FluidBlockWorker::finish()
+{
+    const quint32 block = m_posted.load(std::memory_order_relaxed);
+    for (int i = 0; i < FINISH_SPINS && m_taken.load(std::memory_order_acquire) != block; ++i) {
+    }
+    if (claim(block)) {
+        /* the worker is late, maybe descheduled */
+        work();
+        m_done.store(block, std::memory_order_release);
+        return;
+    }
+    while (m_done.load(std::memory_order_acquire) != block) {
+    }
+}
+
+void FluidBlockWorker::run()
+{
+    //qDebug() << Q_FUNC_INFO;
+    int idle = 0;
+    while (!m_stopping.load(std::memory_order_relaxed)) {
+        const quint32 block = m_posted.load(std::memory_order_acquire);
+        if (block != m_taken.load(std::memory_order_relaxed) && claim(block)) {
+            work();
+            m_done.store(block, std::memory_order_release);
+            idle = 0;
+        } else if (++idle > IDLE_SPINS) {
+            park();
+            idle = 0;
+        }
+    }
+}
+
+FluidPartitionThread::FluidPartitionThread(FluidRenderer *partition, int maxFrames, int channels, QObject *parent):
+    FluidBlockWorker(parent),
+    m_partition(partition),
+    m_buffer(maxFrames * channels, 0.0f),
+    m_frames(0),
+    m_events(0)
+{
+    //qDebug() << Q_FUNC_INFO;
+}
+
+void FluidPartitionThread::render(int frames)
+{
+    m_frames = frames;
+    post();
+}
+
+int FluidPartitionThread::waitRendered()
+{
+    finish();
+    return m_events;
+}
+
+const float *FluidPartitionThread::buffer() const
+{
+    return m_buffer.data();
+}
+
+void FluidPartitionThread::work()
+{
+    m_events = m_partition->render(m_buffer.data(), m_frames);
+}
+
+FluidEffectsThread::FluidEffectsThread(FluidEffects *effects, int maxFrames, QObject *parent):
+    FluidBlockWorker(parent),
+    m_effects(effects),
+    m_sends(maxFrames * FluidEffects::SEND_CHANNELS, 0.0f),
+    m_wet(maxFrames * 2, 0.0f),
+    m_frames(0)
+{
+    //qDebug() << Q_FUNC_INFO;
+}
+
+/* copies the sends, so the caller may render the next block into them */
+void FluidEffectsThread::process(const float *sends, int frames)
+{
+    m_frames = frames;
+    std::copy(sends, sends + frames * FluidEffects::SEND_CHANNELS, m_sends.begin());
+    post();
+}
+
+int FluidEffectsThread::waitProcessed()
+{
+    finish();
+    return m_frames;
+}
+
+const float *FluidEffectsThread::wet() const
+{
+    return m_wet.data();
+}
+
+void FluidEffectsThread::work()
+{
+    std::fill(m_wet.begin(), m_wet.begin() + m_frames * 2, 0.0f);
+    m_effects->process(m_sends.data(), m_wet.data(), m_frames);
+}
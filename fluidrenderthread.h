@@ -0,0 +1,133 @@
+/*
+    Drumstick RT (realtime MIDI In/Out) FluidLite Backend
+    Copyright (C) 2022, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FLUIDRENDERTHREAD_H_
+#define FLUIDRENDERTHREAD_H_
+
+#include <QThread>
+#include <QSemaphore>
+#include <atomic>
+#include <vector>
+
+class FluidEffects;
+class FluidRenderer;
+
+class FluidRenderThread : public QThread
+{
+    Q_OBJECT
+
+public:
+    explicit FluidRenderThread(FluidRenderer *renderer, QObject *parent = nullptr);
+
+protected:
+    void run() override;
+
+private:
+    FluidRenderer *m_renderer;
+};
+
+/**
+ * Does one block of work at a time for the audio thread, without ever
+ * blocking it: post() hands over a block, and finish() spins for a bounded
+ * time waiting for it. When the worker hasn't taken the block by then, the
+ * audio thread does the work itself. After a block the worker polls for a
+ * moment, and then parks until post(), wakeUp() or stop(): a stopped or
+ * suspended renderer posts no blocks, so its workers don't wake up.
+ */
+class FluidBlockWorker : public QThread
+{
+    Q_OBJECT
+
+public:
+    explicit FluidBlockWorker(QObject *parent = nullptr);
+
+    void stop();
+    void wakeUp();
+
+protected:
+    void post();
+    void finish();
+    virtual void work() = 0;
+    void run() override;
+
+private:
+    bool claim(quint32 block);
+    void park();
+
+    std::atomic<quint32> m_posted; // sequence number of the last block handed over
+    std::atomic<quint32> m_taken; // the last block claimed, by either thread
+    std::atomic<quint32> m_done;
+    std::atomic<bool> m_stopping;
+    std::atomic<bool> m_parked; // cleared by the thread waking the worker up
+    QSemaphore m_wakeup;
+};
+
+/**
+ * Renders one channel partition per block, in parallel with the audio
+ * thread: render() hands over a block, and waitRendered() returns once
+ * buffer() holds it, with the number of events processed.
+ */
+class FluidPartitionThread : public FluidBlockWorker
+{
+    Q_OBJECT
+
+public:
+    explicit FluidPartitionThread(FluidRenderer *partition, int maxFrames, int channels, QObject *parent = nullptr);
+
+    void render(int frames);
+    int waitRendered();
+    const float *buffer() const;
+
+protected:
+    void work() override;
+
+private:
+    FluidRenderer *m_partition;
+    std::vector<float> m_buffer;
+    int m_frames;
+    int m_events;
+};
+
+/**
+ * Processes the reverb and chorus of one block while the audio thread
+ * renders the next one: process() hands over the sends of a block, and
+ * waitProcessed() returns once wet() holds its stereo output, with the
+ * number of frames.
+ */
+class FluidEffectsThread : public FluidBlockWorker
+{
+    Q_OBJECT
+
+public:
+    explicit FluidEffectsThread(FluidEffects *effects, int maxFrames, QObject *parent = nullptr);
+
+    void process(const float *sends, int frames);
+    int waitProcessed();
+    const float *wet() const;
+
+protected:
+    void work() override;
+
+private:
+    FluidEffects *m_effects;
+    std::vector<float> m_sends;
+    std::vector<float> m_wet;
+    int m_frames;
+};
+
+#endif /*FLUIDRENDERTHREAD_H_*/
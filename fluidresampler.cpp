@@ -0,0 +1,185 @@
+/*
+    Drumstick RT (realtime MIDI In/Out) FluidLite Backend
+    Copyright (C) 2022, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QtGlobal>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <immintrin.h>
+#define FLUID_SSE2 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define FLUID_NEON 1
+#endif
+
+#include "fluidresampler.h"
+
+static const double PI = 3.14159265358979323846;
+static const double KAISER_BETA = 8.0;
+
+/* zeroth order modified Bessel function of the first kind */
+static double bessel0(double x)
+{
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 32; ++k) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+/* TAPS is a multiple of the vector width */
+static inline float dot(const float *a, const float *b)
+{
+#if defined(FLUID_SSE2)
+    __m128 sum = _mm_setzero_ps();
+    for (int i = 0; i < FluidResampler::TAPS; i += 4) {
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    }
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum);
+#elif defined(FLUID_NEON)
+    float32x4_t sum = vdupq_n_f32(0.0f);
+    for (int i = 0; i < FluidResampler::TAPS; i += 4) {
+        sum = vmlaq_f32(sum, vld1q_f32(a + i), vld1q_f32(b + i));
+    }
+    return vaddvq_f32(sum);
+#else
+    float sum = 0.0f;
+    for (int i = 0; i < FluidResampler::TAPS; ++i) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+#endif
+}
+
+FluidResampler::FluidResampler():
+    m_channels(0),
+    m_capacity(0),
+    m_length(0),
+    m_step(1.0),
+    m_position(0.0),
+    m_active(false)
+{ }
+
+void FluidResampler::setup(int inputRate, int outputRate, int channels, int maxInputFrames)
+{
+    m_active = (inputRate > 0 && outputRate > 0 && inputRate != outputRate);
+    m_channels = channels;
+    m_step = m_active ? static_cast<double>(inputRate) / outputRate : 1.0;
+    if (!m_active) {
+        m_filters.clear();
+        m_history.clear();
+        return;
+    }
+    /* cutoff relative to the input rate, below the lower of both Nyquist frequencies */
+    const double cutoff = 0.45 * qMin(1.0, static_cast<double>(outputRate) / inputRate);
+    const double center = TAPS / 2 - 1;
+    m_filters.assign((PHASES + 1) * TAPS, 0.0f);
+    for (int phase = 0; phase <= PHASES; ++phase) {
+        float *filter = &m_filters[phase * TAPS];
+        const double offset = static_cast<double>(phase) / PHASES;
+        double sum = 0.0;
+        for (int tap = 0; tap < TAPS; ++tap) {
+            const double x = tap - center - offset;
+            const double sinc = (x == 0.0) ? 1.0 : std::sin(2.0 * PI * cutoff * x) / (2.0 * PI * cutoff * x);
+            const double r = x / (TAPS / 2);
+            const double window = (std::fabs(r) >= 1.0) ? 0.0 : bessel0(KAISER_BETA * std::sqrt(1.0 - r * r)) / bessel0(KAISER_BETA);
+            filter[tap] = static_cast<float>(sinc * window);
+            sum += filter[tap];
+        }
+        for (int tap = 0; tap < TAPS; ++tap) {
+            filter[tap] = static_cast<float>(filter[tap] / sum);
+        }
+    }
+    m_capacity = TAPS + maxInputFrames + static_cast<int>(std::ceil(m_step)) + 1;
+    m_history.assign(m_channels, std::vector<float>(m_capacity, 0.0f));
+    reset();
+}
+
+void FluidResampler::reset()
+{
+    for (auto &history : m_history) {
+        std::fill(history.begin(), history.end(), 0.0f);
+    }
+    /* start with a history of silence */
+    m_length = TAPS - 1;
+    m_position = 0.0;
+}
+
+bool FluidResampler::isActive() const
+{
+    return m_active;
+}
+
+bool FluidResampler::needsInput() const
+{
+    return static_cast<int>(m_position) + TAPS > m_length;
+}
+
+void FluidResampler::write(const float *input, int frames)
+{
+    Q_ASSERT(m_length + frames <= m_capacity);
+    for (int chan = 0; chan < m_channels; ++chan) {
+        float *history = m_history[chan].data() + m_length;
+        for (int i = 0; i < frames; ++i) {
+            history[i] = input[i * m_channels + chan];
+        }
+    }
+    m_length += frames;
+}
+
+int FluidResampler::read(float *output, int frames)
+{
+    int done = 0;
+    while (done < frames && !needsInput()) {
+        const int base = static_cast<int>(m_position);
+        const double phase = (m_position - base) * PHASES;
+        const int index = static_cast<int>(phase);
+        const float weight = static_cast<float>(phase - index);
+        const float *lower = &m_filters[index * TAPS];
+        const float *upper = lower + TAPS;
+        for (int chan = 0; chan < m_channels; ++chan) {
+            const float *samples = m_history[chan].data() + base;
+            const float a = dot(lower, samples);
+            const float b = dot(upper, samples);
+            output[done * m_channels + chan] = a + (b - a) * weight;
+        }
+        m_position += m_step;
+        ++done;
+    }
+    /* drop the input that no output needs any more */
+    const int consumed = qMin(static_cast<int>(m_position), m_length);
+    if (consumed > 0) {
+        for (auto &history : m_history) {
+            std::memmove(history.data(), history.data() + consumed, (m_length - consumed) * sizeof(float));
+        }
+        m_length -= consumed;
+        m_position -= consumed;
+    }
+    return done;
+}
+
+/* the filter delay, in input frames */
+double FluidResampler::latency() const
+{
+    return m_active ? TAPS / 2 : 0.0;
+}
@@ -0,0 +1,62 @@
+/*
+    Drumstick RT (realtime MIDI In/Out) FluidLite Backend
+    Copyright (C) 2022, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FLUIDRESAMPLER_H_
+#define FLUIDRESAMPLER_H_
+
+#include <vector>
+#include <cstddef>
+
+/**
+ * Polyphase windowed sinc resampler for interleaved float frames.
+ *
+ * The filter bank has PHASES + 1 Kaiser windowed sinc phases of TAPS
+ * coefficients, cut off below the lower Nyquist frequency, and the output
+ * interpolates between the two nearest phases. write() appends input
+ * frames, and read() produces output frames while there is enough input;
+ * needsInput() tells when read() can't produce any more. All buffers are
+ * allocated by setup(), so write() and read() are realtime safe.
+ */
+class FluidResampler
+{
+public:
+    static const int TAPS = 32;
+    static const int PHASES = 256;
+
+    FluidResampler();
+
+    void setup(int inputRate, int outputRate, int channels, int maxInputFrames);
+    void reset();
+    bool isActive() const;
+    bool needsInput() const;
+    void write(const float *input, int frames);
+    int read(float *output, int frames);
+    double latency() const;
+
+private:
+    int m_channels;
+    int m_capacity;
+    int m_length;
+    double m_step;
+    double m_position;
+    bool m_active;
+    std::vector<float> m_filters;
+    std::vector<std::vector<float> > m_history; // deinterleaved, one per channel
+};
+
+#endif /*FLUIDRESAMPLER_H_*/
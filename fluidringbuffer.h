@@ -0,0 +1,196 @@
+/*
+    Drumstick RT (realtime MIDI In/Out) FluidLite Backend
+    Copyright (C) 2022, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FLUIDRINGBUFFER_H_
+#define FLUIDRINGBUFFER_H_
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+
+/**
+ * Wait-free single producer / single consumer ring buffer.
+ *
+ * One thread may call the producer methods (push, write, writeAvailable)
+ * while another thread calls the consumer methods (pop, front, read,
+ * readRegion, skip, readAvailable, clear); size() may be called from
+ * anywhere. The capacity is rounded up to a power of two, and resize() must
+ * not be called while any other thread uses the buffer.
+ */
+template<typename T>
+class FluidRingBuffer
+{
+public:
+    explicit FluidRingBuffer(size_t capacity = 0)
+        : m_mask(0), m_head(0), m_tail(0), m_cachedHead(0), m_cachedTail(0)
+    {
+        resize(capacity);
+    }
+
+    void resize(size_t capacity)
+    {
+        size_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        m_buffer.assign(capacity > 0 ? size : 0, T());
+        m_mask = capacity > 0 ? size - 1 : 0;
+        m_head.store(0, std::memory_order_relaxed);
+        m_tail.store(0, std::memory_order_relaxed);
+        m_cachedHead = 0;
+        m_cachedTail = 0;
+    }
+
+    size_t capacity() const
+    {
+        return m_buffer.size();
+    }
+
+    /* approximate fill level, safe to call from any thread */
+    size_t size() const
+    {
+        const size_t tail = m_tail.load(std::memory_order_acquire);
+        const size_t head = m_head.load(std::memory_order_acquire);
+        const size_t used = head - tail;
+        return used < m_buffer.size() ? used : m_buffer.size();
+    }
+
+    /* producer side */
+
+    size_t writeAvailable()
+    {
+        const size_t head = m_head.load(std::memory_order_relaxed);
+        m_cachedTail = m_tail.load(std::memory_order_acquire);
+        return m_buffer.size() - (head - m_cachedTail);
+    }
+
+    bool push(const T &item)
+    {
+        const size_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_cachedTail >= m_buffer.size()) {
+            m_cachedTail = m_tail.load(std::memory_order_acquire);
+            if (head - m_cachedTail >= m_buffer.size()) {
+                return false;
+            }
+        }
+        m_buffer[head & m_mask] = item;
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t write(const T *items, size_t count)
+    {
+        const size_t head = m_head.load(std::memory_order_relaxed);
+        size_t free = m_buffer.size() - (head - m_cachedTail);
+        if (free < count) {
+            m_cachedTail = m_tail.load(std::memory_order_acquire);
+            free = m_buffer.size() - (head - m_cachedTail);
+        }
+        if (count > free) {
+            count = free;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            m_buffer[(head + i) & m_mask] = items[i];
+        }
+        m_head.store(head + count, std::memory_order_release);
+        return count;
+    }
+
+    /* consumer side */
+
+    size_t readAvailable()
+    {
+        const size_t tail = m_tail.load(std::memory_order_relaxed);
+        m_cachedHead = m_head.load(std::memory_order_acquire);
+        return m_cachedHead - tail;
+    }
+
+    const T *front()
+    {
+        const size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail == m_cachedHead) {
+            m_cachedHead = m_head.load(std::memory_order_acquire);
+            if (tail == m_cachedHead) {
+                return nullptr;
+            }
+        }
+        return &m_buffer[tail & m_mask];
+    }
+
+    bool pop(T &item)
+    {
+        const T *next = front();
+        if (next == nullptr) {
+            return false;
+        }
+        item = *next;
+        m_tail.store(m_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t read(T *items, size_t count)
+    {
+        const size_t tail = m_tail.load(std::memory_order_relaxed);
+        size_t used = m_cachedHead - tail;
+        if (used < count) {
+            m_cachedHead = m_head.load(std::memory_order_acquire);
+            used = m_cachedHead - tail;
+        }
+        if (count > used) {
+            count = used;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            items[i] = m_buffer[(tail + i) & m_mask];
+        }
+        m_tail.store(tail + count, std::memory_order_release);
+        return count;
+    }
+
+    /* the readable items up to the end of the storage, to be used in place */
+    const T *readRegion(size_t &count)
+    {
+        const size_t tail = m_tail.load(std::memory_order_relaxed);
+        m_cachedHead = m_head.load(std::memory_order_acquire);
+        const size_t used = m_cachedHead - tail;
+        const size_t contiguous = m_buffer.size() - (tail & m_mask);
+        count = used < contiguous ? used : contiguous;
+        return m_buffer.data() + (tail & m_mask);
+    }
+
+    /* releases items seen through readRegion() */
+    void skip(size_t count)
+    {
+        m_tail.store(m_tail.load(std::memory_order_relaxed) + count, std::memory_order_release);
+    }
+
+    void clear()
+    {
+        m_cachedHead = m_head.load(std::memory_order_acquire);
+        m_tail.store(m_cachedHead, std::memory_order_release);
+    }
+
+private:
+    std::vector<T> m_buffer;
+    size_t m_mask;
+    alignas(64) std::atomic<size_t> m_head;
+    alignas(64) std::atomic<size_t> m_tail;
+    alignas(64) size_t m_cachedHead; // consumer's copy of m_head
+    alignas(64) size_t m_cachedTail; // producer's copy of m_tail
+};
+
+#endif /*FLUIDRINGBUFFER_H_*/
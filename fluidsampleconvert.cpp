@@ -0,0 +1,201 @@
+/*
+    Drumstick RT (realtime MIDI In/Out) FluidLite Backend
+    Copyright (C) 2022, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QtGlobal>
+#include <cmath>
+#include <cstring>
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <immintrin.h>
+#define FLUID_SSE2 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define FLUID_NEON 1
+#endif
+
+#include "fluidsampleconvert.h"
+
+/* the largest float below 2^31, the positive full scale of Int32 */
+static const float INT32_MAX_FLOAT = 2147483520.0f;
+
+static inline float clip(float sample)
+{
+    return sample < -1.0f ? -1.0f : (sample > 1.0f ? 1.0f : sample);
+}
+
+int FluidSampleConverter::sampleBytes(Format format)
+{
+    switch (format) {
+    case Int16:
+        return 2;
+    case Int24:
+        return 3;
+    case Int32:
+    case Float:
+    default:
+        return 4;
+    }
+}
+
+QString FluidSampleConverter::formatName(Format format)
+{
+    switch (format) {
+    case Int16:
+        return QStringLiteral("Int16");
+    case Int24:
+        return QStringLiteral("Int24");
+    case Int32:
+        return QStringLiteral("Int32");
+    case Float:
+    default:
+        return QStringLiteral("Float");
+    }
+}
+
+QString FluidSampleConverter::instructionSet()
+{
+#if defined(__AVX2__)
+    return QStringLiteral("AVX2");
+#elif defined(FLUID_SSE2)
+    return QStringLiteral("SSE2");
+#elif defined(FLUID_NEON)
+    return QStringLiteral("NEON");
+#else
+    return QStringLiteral("scalar");
+#endif
+}
+
+void FluidSampleConverter::convert(Format format, const float *src, void *dst, size_t count)
+{
+    switch (format) {
+    case Int16:
+        toInt16(src, static_cast<qint16 *>(dst), count);
+        break;
+    case Int24:
+        toInt24(src, static_cast<char *>(dst), count);
+        break;
+    case Int32:
+        toInt32(src, static_cast<qint32 *>(dst), count);
+        break;
+    case Float:
+    default:
+        std::memcpy(dst, src, count * sizeof(float));
+        break;
+    }
+}
+
+void FluidSampleConverter::toInt16(const float *src, qint16 *dst, size_t count)
+{
+    size_t i = 0;
+#if defined(__AVX2__)
+    const __m256 lo = _mm256_set1_ps(-1.0f);
+    const __m256 hi = _mm256_set1_ps(1.0f);
+    const __m256 scale = _mm256_set1_ps(32767.0f);
+    for (; i + 16 <= count; i += 16) {
+        const __m256 a = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(src + i), lo), hi);
+        const __m256 b = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(src + i + 8), lo), hi);
+        const __m256i ia = _mm256_cvtps_epi32(_mm256_mul_ps(a, scale));
+        const __m256i ib = _mm256_cvtps_epi32(_mm256_mul_ps(b, scale));
+        /* packs works on each 128 bit lane, restore the order of the quadwords */
+        const __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(ia, ib), 0xD8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), packed);
+    }
+#elif defined(FLUID_SSE2)
+    const __m128 lo = _mm_set1_ps(-1.0f);
+    const __m128 hi = _mm_set1_ps(1.0f);
+    const __m128 scale = _mm_set1_ps(32767.0f);
+    for (; i + 8 <= count; i += 8) {
+        const __m128 a = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i), lo), hi);
+        const __m128 b = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i + 4), lo), hi);
+        const __m128i ia = _mm_cvtps_epi32(_mm_mul_ps(a, scale));
+        const __m128i ib = _mm_cvtps_epi32(_mm_mul_ps(b, scale));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_packs_epi32(ia, ib));
+    }
+#elif defined(FLUID_NEON)
+    const float32x4_t lo = vdupq_n_f32(-1.0f);
+    const float32x4_t hi = vdupq_n_f32(1.0f);
+    for (; i + 8 <= count; i += 8) {
+        const float32x4_t a = vminq_f32(vmaxq_f32(vld1q_f32(src + i), lo), hi);
+        const float32x4_t b = vminq_f32(vmaxq_f32(vld1q_f32(src + i + 4), lo), hi);
+        const int32x4_t ia = vcvtnq_s32_f32(vmulq_n_f32(a, 32767.0f));
+        const int32x4_t ib = vcvtnq_s32_f32(vmulq_n_f32(b, 32767.0f));
+        vst1q_s16(dst + i, vcombine_s16(vqmovn_s32(ia), vqmovn_s32(ib)));
+    }
+#endif
+    for (; i < count; ++i) {
+        dst[i] = static_cast<qint16>(std::lrint(clip(src[i]) * 32767.0f));
+    }
+}
+
+void FluidSampleConverter::toInt32(const float *src, qint32 *dst, size_t count)
+{
+    size_t i = 0;
+#if defined(__AVX2__)
+    const __m256 lo = _mm256_set1_ps(-1.0f);
+    const __m256 scale = _mm256_set1_ps(2147483648.0f);
+    const __m256 max = _mm256_set1_ps(INT32_MAX_FLOAT);
+    for (; i + 8 <= count; i += 8) {
+        const __m256 a = _mm256_mul_ps(_mm256_max_ps(_mm256_loadu_ps(src + i), lo), scale);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_cvtps_epi32(_mm256_min_ps(a, max)));
+    }
+#elif defined(FLUID_SSE2)
+    const __m128 lo = _mm_set1_ps(-1.0f);
+    const __m128 scale = _mm_set1_ps(2147483648.0f);
+    const __m128 max = _mm_set1_ps(INT32_MAX_FLOAT);
+    for (; i + 4 <= count; i += 4) {
+        const __m128 a = _mm_mul_ps(_mm_max_ps(_mm_loadu_ps(src + i), lo), scale);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_cvtps_epi32(_mm_min_ps(a, max)));
+    }
+#elif defined(FLUID_NEON)
+    const float32x4_t lo = vdupq_n_f32(-1.0f);
+    const float32x4_t max = vdupq_n_f32(INT32_MAX_FLOAT);
+    for (; i + 4 <= count; i += 4) {
+        const float32x4_t a = vmulq_n_f32(vmaxq_f32(vld1q_f32(src + i), lo), 2147483648.0f);
+        vst1q_s32(dst + i, vcvtnq_s32_f32(vminq_f32(a, max)));
+    }
+#endif
+    for (; i < count; ++i) {
+        dst[i] = static_cast<qint32>(std::lrint(qMin(clip(src[i]) * 2147483648.0f, INT32_MAX_FLOAT)));
+    }
+}
+
+/* the vectorized Int32 conversion, keeping the 24 most significant bits */
+void FluidSampleConverter::toInt24(const float *src, char *dst, size_t count)
+{
+    const size_t CHUNK = 256;
+    qint32 chunk[CHUNK];
+    while (count > 0) {
+        const size_t n = count < CHUNK ? count : CHUNK;
+        toInt32(src, chunk, n);
+        for (size_t i = 0; i < n; ++i) {
+            const qint32 sample = chunk[i] >> 8;
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+            dst[0] = static_cast<char>(sample);
+            dst[1] = static_cast<char>(sample >> 8);
+            dst[2] = static_cast<char>(sample >> 16);
+#else
+            dst[0] = static_cast<char>(sample >> 16);
+            dst[1] = static_cast<char>(sample >> 8);
+            dst[2] = static_cast<char>(sample);
+#endif
+            dst += 3;
+        }
+        src += n;
+        count -= n;
+    }
+}
@@ -0,0 +1,51 @@
+/*
+    Drumstick RT (realtime MIDI In/Out) FluidLite Backend
+    Copyright (C) 2022, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FLUIDSAMPLECONVERT_H_
+#define FLUIDSAMPLECONVERT_H_
+
+#include <QString>
+#include <cstddef>
+
+/**
+ * Conversion of the rendered float samples to the integer formats accepted
+ * by the audio devices, clipping to the full scale range. The SSE2, AVX2 or
+ * NEON implementation is selected at compile time, by the target flags.
+ */
+class FluidSampleConverter
+{
+public:
+    enum Format {
+        Float,
+        Int16,
+        Int24, // packed, three bytes per sample
+        Int32
+    };
+
+    static int sampleBytes(Format format);
+    static QString formatName(Format format);
+    static QString instructionSet();
+    static void convert(Format format, const float *src, void *dst, size_t count);
+
+private:
+    static void toInt16(const float *src, qint16 *dst, size_t count);
+    static void toInt24(const float *src, char *dst, size_t count);
+    static void toInt32(const float *src, qint32 *dst, size_t count);
+};
+
+#endif /*FLUIDSAMPLECONVERT_H_*/
@@ -155,7 +155,6 @@ void FluidSettingsDialog::chkDriverProperties(QSettings *settings)
     //qDebug() << Q_FUNC_INFO;
     if (m_driver != nullptr) {
         drumstick::rt::MIDIConnection conn;
-        m_driver->close();
         m_driver->initialize(settings);
         m_driver->open(conn);
 
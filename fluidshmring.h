@@ -0,0 +1,219 @@
+/*
+    Drumstick RT (realtime MIDI In/Out) FluidLite Backend
+    Copyright (C) 2022, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FLUIDSHMRING_H_
+#define FLUIDSHMRING_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @file fluidshmring.h
+ * The shared memory audio ring written by the SharedMemory audio backend,
+ * and a reader for other processes. This header only needs POSIX and the
+ * C++ standard library, so it may be copied into the reading project.
+ *
+ * The shared memory object starts with a FluidShmHeader, followed at
+ * headerSize by capacity interleaved 32 bit float frames. The writer renders
+ * blockFrames frames at a time in place, storing frame n at index
+ * n % capacity, and then publishes writeIndex = n + 1 with release
+ * semantics. A reader loads writeIndex with acquire semantics and reads the
+ * frames before it in place. The writer never waits for readers, and while
+ * it writes the block after writeIndex, it overwrites the frames from
+ * writeIndex - capacity on. So a frame n read is valid if, loading
+ * writeIndex again after an acquire fence once the reader is done with it,
+ * writeIndex - n <= capacity - blockFrames.
+ */
+
+#if ATOMIC_LLONG_LOCK_FREE != 2 || ATOMIC_INT_LOCK_FREE != 2
+#error "the shared memory ring needs lock-free 32 and 64 bit atomics"
+#endif
+
+struct FluidShmHeader
+{
+    static const uint32_t MAGIC = 0x46534852; // "FSHR"
+    static const uint32_t VERSION = 2;
+
+    enum State : uint32_t {
+        Stopped,
+        Running,
+        Suspended // no frames while the synth is idle
+    };
+
+    uint32_t magic;
+    uint32_t version;
+    uint32_t headerSize; // offset of the first frame
+    uint32_t sampleRate;
+    uint32_t channels;
+    uint32_t capacity; // frames, a power of two
+    uint32_t blockFrames; // written in place before being published, less than capacity
+    std::atomic<uint32_t> state;
+    alignas(64) std::atomic<uint64_t> writeIndex; // frames written since the start
+    alignas(64) std::atomic<uint64_t> xruns; // times the writer fell behind real time
+
+    const float *frames() const
+    {
+        return reinterpret_cast<const float *>(reinterpret_cast<const char *>(this) + headerSize);
+    }
+
+    float *frames()
+    {
+        return reinterpret_cast<float *>(reinterpret_cast<char *>(this) + headerSize);
+    }
+
+    static size_t byteSize(uint32_t channels, uint32_t capacity)
+    {
+        return sizeof(FluidShmHeader) + static_cast<size_t>(channels) * capacity * sizeof(float);
+    }
+};
+
+/**
+ * Maps a ring read-only and follows the writer from the newest frame.
+ * Frames are consumed in place with readRegion() and skip(), or copied
+ * with read(). After an overrun, the position jumps to the oldest frame
+ * still in the ring.
+ */
+class FluidShmReader
+{
+public:
+    FluidShmReader() : m_header(nullptr), m_size(0), m_position(0) { }
+    ~FluidShmReader() { close(); }
+
+    bool open(const char *name)
+    {
+        close();
+        const int fd = shm_open(name, O_RDONLY, 0);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        void *address = MAP_FAILED;
+        if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(FluidShmHeader)) {
+            address = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        }
+        ::close(fd);
+        if (address == MAP_FAILED) {
+            return false;
+        }
+        m_header = static_cast<const FluidShmHeader *>(address);
+        m_size = st.st_size;
+        const bool valid = m_header->magic == FluidShmHeader::MAGIC;
+        /* the writer stores the magic number after the rest of the header */
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (!valid || m_header->version != FluidShmHeader::VERSION ||
+            m_header->blockFrames == 0 || m_header->blockFrames >= m_header->capacity ||
+            FluidShmHeader::byteSize(m_header->channels, m_header->capacity) > m_size) {
+            close();
+            return false;
+        }
+        m_position = m_header->writeIndex.load(std::memory_order_acquire);
+        return true;
+    }
+
+    void close()
+    {
+        if (m_header != nullptr) {
+            munmap(const_cast<FluidShmHeader *>(m_header), m_size);
+            m_header = nullptr;
+        }
+    }
+
+    const FluidShmHeader *header() const
+    {
+        return m_header;
+    }
+
+    /* the absolute frame index of the next frame to read */
+    uint64_t position() const
+    {
+        return m_position;
+    }
+
+    /* the frames ready to read, skipping the ones overwritten or about to be */
+    size_t available()
+    {
+        const uint64_t written = m_header->writeIndex.load(std::memory_order_acquire);
+        if (written - m_position > margin()) {
+            m_position = written - margin();
+        }
+        return static_cast<size_t>(written - m_position);
+    }
+
+    /* the readable frames up to the end of the ring, to be used in place */
+    const float *readRegion(size_t &count)
+    {
+        const size_t ready = available();
+        const size_t index = static_cast<size_t>(m_position & (m_header->capacity - 1));
+        const size_t contiguous = m_header->capacity - index;
+        count = ready < contiguous ? ready : contiguous;
+        return m_header->frames() + index * m_header->channels;
+    }
+
+    /* releases frames seen through readRegion(); false if they were overwritten meanwhile */
+    bool skip(size_t count)
+    {
+        /* the frames were read before loading writeIndex again */
+        std::atomic_thread_fence(std::memory_order_acquire);
+        const bool valid = m_header->writeIndex.load(std::memory_order_relaxed) - m_position <= margin();
+        m_position += count;
+        return valid;
+    }
+
+    /* copies up to count frames, returning the number of frames copied */
+    size_t read(float *dest, size_t count)
+    {
+        size_t done = 0;
+        while (done < count) {
+            size_t region;
+            const float *frames = readRegion(region);
+            if (region == 0) {
+                break;
+            }
+            if (region > count - done) {
+                region = count - done;
+            }
+            std::memcpy(dest + done * m_header->channels, frames, region * m_header->channels * sizeof(float));
+            if (!skip(region)) {
+                /* overwritten while copying, start again from the oldest frame */
+                available();
+                continue;
+            }
+            done += region;
+        }
+        return done;
+    }
+
+private:
+    /* how far the reader may trail writeIndex, out of the block being written */
+    uint64_t margin() const
+    {
+        return m_header->capacity - m_header->blockFrames;
+    }
+
+    const FluidShmHeader *m_header;
+    size_t m_size;
+    uint64_t m_position;
+};
+
+#endif /*FLUIDSHMRING_H_*/
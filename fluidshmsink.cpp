@@ -0,0 +1,297 @@
+/*
+    Drumstick RT (realtime MIDI In/Out) FluidLite Backend
+    Copyright (C) 2022, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QElapsedTimer>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <new>
+
+#include "fluidrenderer.h"
+#include "fluidshmsink.h"
+
+static const int WAIT_TIMEOUT = 100; // ms, to notice the interruption requests
+
+FluidShmSink::FluidShmSink(FluidRenderer *renderer, QObject *parent):
+    QThread(parent),
+    m_renderer(renderer),
+    m_header(nullptr),
+    m_size(0),
+    m_bufferTime(0),
+    m_framesPlayed(0),
+    m_suspended(false)
+{
+    //qDebug() << Q_FUNC_INFO;
+}
+
+FluidShmSink::~FluidShmSink()
+{
+    close();
+    //qDebug() << Q_FUNC_INFO;
+}
+
+/**
+ * Creates the shared memory object. An existing one with the same name is
+ * only replaced when it is a ring left in the Stopped state; otherwise
+ * another writer may be using it, and open() fails with EEXIST. The ring
+ * holds at least one second and four buffers of float frames, rounded up
+ * to a power of two, so readers polling at their own pace have some slack.
+ */
+bool FluidShmSink::open(const QString &name, int sampleRate, int channels, int bufferTime)
+{
+    close();
+    const QByteArray path = (name.startsWith('/') ? name : QLatin1Char('/') + name).toLocal8Bit();
+    const qint64 bufferFrames = static_cast<qint64>(bufferTime) * sampleRate / 1000;
+    uint32_t capacity = 1;
+    const uint32_t block = static_cast<uint32_t>(m_renderer->renderingFrames());
+    while (capacity < static_cast<uint32_t>(sampleRate) || capacity < bufferFrames * 4 || capacity < block * 2) {
+        capacity <<= 1;
+    }
+    const size_t size = FluidShmHeader::byteSize(channels, capacity);
+    int fd = shm_open(path.constData(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0 && errno == EEXIST) {
+        if (!isStale(path.constData())) {
+            m_errorString = tr("Cannot create the shared memory %1: %2").arg(name, QString::fromLocal8Bit(std::strerror(EEXIST)));
+            return false;
+        }
+        shm_unlink(path.constData());
+        fd = shm_open(path.constData(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    }
+    if (fd < 0) {
+        m_errorString = tr("Cannot create the shared memory %1: %2").arg(name, QString::fromLocal8Bit(std::strerror(errno)));
+        return false;
+    }
+    void *address = MAP_FAILED;
+    if (ftruncate(fd, static_cast<off_t>(size)) == 0) {
+        address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    const int err = errno;
+    ::close(fd);
+    if (address == MAP_FAILED) {
+        m_errorString = tr("Cannot map the shared memory %1: %2").arg(name, QString::fromLocal8Bit(std::strerror(err)));
+        shm_unlink(path.constData());
+        return false;
+    }
+    /* a new object is zero filled: the frames are silence, and the atomics start at zero */
+    m_header = new (address) FluidShmHeader;
+    m_header->headerSize = sizeof(FluidShmHeader);
+    m_header->sampleRate = static_cast<uint32_t>(sampleRate);
+    m_header->channels = static_cast<uint32_t>(channels);
+    m_header->capacity = capacity;
+    m_header->blockFrames = block;
+    m_header->version = FluidShmHeader::VERSION;
+    /* taken, but without frames until run() starts: Stopped rings may be replaced */
+    m_header->state.store(FluidShmHeader::Suspended, std::memory_order_relaxed);
+    m_header->writeIndex.store(0, std::memory_order_relaxed);
+    m_header->xruns.store(0, std::memory_order_relaxed);
+    /* readers check the magic number last */
+    std::atomic_thread_fence(std::memory_order_release);
+    m_header->magic = FluidShmHeader::MAGIC;
+    m_name = QString::fromLocal8Bit(path);
+    m_size = size;
+    m_bufferTime = bufferTime;
+    m_block.assign(static_cast<size_t>(m_renderer->renderingFrames()) * channels, 0.0f);
+    m_framesPlayed.store(0, std::memory_order_relaxed);
+    return true;
+}
+
+/* a ring with a valid header, whose writer has stopped */
+bool FluidShmSink::isStale(const char *path)
+{
+    const int fd = shm_open(path, O_RDONLY, 0);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    void *address = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(FluidShmHeader)) {
+        address = mmap(nullptr, sizeof(FluidShmHeader), PROT_READ, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (address == MAP_FAILED) {
+        return false;
+    }
+    const FluidShmHeader *header = static_cast<const FluidShmHeader *>(address);
+    const bool stale = header->magic == FluidShmHeader::MAGIC && header->version == FluidShmHeader::VERSION &&
+                       header->state.load(std::memory_order_acquire) == FluidShmHeader::Stopped;
+    munmap(address, sizeof(FluidShmHeader));
+    return stale;
+}
+
+/* the readers keep their mappings, but no new reader finds the ring */
+void FluidShmSink::close()
+{
+    stop();
+    if (m_header != nullptr) {
+        m_header->state.store(FluidShmHeader::Stopped, std::memory_order_release);
+        munmap(m_header, m_size);
+        shm_unlink(m_name.toLocal8Bit().constData());
+        m_header = nullptr;
+    }
+}
+
+void FluidShmSink::stop()
+{
+    //qDebug() << Q_FUNC_INFO;
+    if (isRunning()) {
+        requestInterruption();
+        m_resumed.release();
+        wait();
+    }
+}
+
+/* while suspended, the renderer is not pulled and readers see the Suspended state */
+void FluidShmSink::setSuspended(bool suspended)
+{
+    m_suspended.store(suspended, std::memory_order_release);
+    if (!suspended) {
+        m_resumed.release();
+    }
+}
+
+QString FluidShmSink::name() const
+{
+    return m_name;
+}
+
+int FluidShmSink::sampleRate() const
+{
+    return m_header != nullptr ? static_cast<int>(m_header->sampleRate) : 0;
+}
+
+/* the ring size, in frames */
+int FluidShmSink::capacity() const
+{
+    return m_header != nullptr ? static_cast<int>(m_header->capacity) : 0;
+}
+
+int FluidShmSink::bufferTime() const
+{
+    return m_bufferTime;
+}
+
+/* safe to call from any thread */
+qint64 FluidShmSink::processedUSecs() const
+{
+    const int rate = sampleRate();
+    return rate > 0 ? m_framesPlayed.load(std::memory_order_relaxed) * 1000000 / rate : 0;
+}
+
+quint64 FluidShmSink::xruns() const
+{
+    return m_header != nullptr ? m_header->xruns.load(std::memory_order_relaxed) : 0;
+}
+
+QString FluidShmSink::errorString() const
+{
+    return m_errorString;
+}
+
+/**
+ * Renders whole blocks in place, publishing each one as soon as it is
+ * written. The release fence orders the last writeIndex store before the
+ * frames of the next block, which overwrite the oldest ones: a reader that
+ * sees any of them sees the new writeIndex, see FluidShmReader::skip().
+ */
+void FluidShmSink::fill(qint64 frames)
+{
+    const int channels = static_cast<int>(m_header->channels);
+    const uint64_t mask = m_header->capacity - 1;
+    const qint64 block = m_renderer->renderingFrames();
+    const qint64 blockBytes = block * channels * static_cast<qint64>(sizeof(float));
+    float *ring = m_header->frames();
+    for (qint64 done = 0; done < frames; done += block) {
+        const uint64_t position = m_header->writeIndex.load(std::memory_order_relaxed);
+        const uint64_t index = position & mask;
+        std::atomic_thread_fence(std::memory_order_release);
+        const qint64 contiguous = static_cast<qint64>(m_header->capacity - index);
+        if (contiguous >= block) {
+            char *dest = reinterpret_cast<char *>(ring + index * channels);
+            if (m_renderer->read(dest, blockBytes) <= 0) {
+                std::memset(dest, 0, static_cast<size_t>(blockBytes));
+            }
+        } else {
+            if (m_renderer->read(reinterpret_cast<char *>(m_block.data()), blockBytes) <= 0) {
+                std::fill(m_block.begin(), m_block.end(), 0.0f);
+            }
+            std::memcpy(ring + index * channels, m_block.data(), contiguous * channels * sizeof(float));
+            std::memcpy(ring, m_block.data() + contiguous * channels, (block - contiguous) * channels * sizeof(float));
+        }
+        m_header->writeIndex.store(position + block, std::memory_order_release);
+    }
+}
+
+/**
+ * Keeps the ring bufferTime milliseconds ahead of the clock, a block at a
+ * time. The renderer must be started, with float output samples.
+ */
+void FluidShmSink::run()
+{
+    //qDebug() << Q_FUNC_INFO;
+    if (m_header == nullptr) {
+        return;
+    }
+    const qint64 NSECS = Q_INT64_C(1000000000);
+    const qint64 rate = m_header->sampleRate;
+    const qint64 block = m_renderer->renderingFrames();
+    const qint64 bufferFrames = qMax(block, static_cast<qint64>(m_bufferTime) * rate / 1000 / block * block);
+    /* the clock counts from the frame at base, which readers were due to play then */
+    QElapsedTimer clock;
+    qint64 base = static_cast<qint64>(m_header->writeIndex.load(std::memory_order_relaxed));
+    qint64 played = m_framesPlayed.load(std::memory_order_relaxed); // before base
+    m_header->state.store(FluidShmHeader::Running, std::memory_order_release);
+    clock.start();
+    while (!isInterruptionRequested()) {
+        if (m_suspended.load(std::memory_order_acquire)) {
+            m_header->state.store(FluidShmHeader::Suspended, std::memory_order_release);
+            while (m_suspended.load(std::memory_order_acquire) && !isInterruptionRequested()) {
+                m_resumed.tryAcquire(1, WAIT_TIMEOUT);
+            }
+            m_header->state.store(FluidShmHeader::Running, std::memory_order_release);
+            /* the readers have played what was buffered meanwhile */
+            const qint64 written = static_cast<qint64>(m_header->writeIndex.load(std::memory_order_relaxed));
+            played += written - base;
+            base = written;
+            clock.restart();
+            continue;
+        }
+        const qint64 written = static_cast<qint64>(m_header->writeIndex.load(std::memory_order_relaxed));
+        /* the whole seconds are scaled apart, nsecs * rate overflows in a day */
+        const qint64 nsecs = clock.nsecsElapsed();
+        const qint64 due = base + nsecs / NSECS * rate + nsecs % NSECS * rate / NSECS;
+        if (due > written) {
+            /* the readers have run out of frames: start again from now */
+            m_header->xruns.fetch_add(1, std::memory_order_relaxed);
+            emit underrunDetected();
+            played += written - base;
+            base = written;
+            clock.restart();
+            continue;
+        }
+        m_framesPlayed.store(played + due - base, std::memory_order_relaxed);
+        const qint64 missing = (due + bufferFrames - written) / block * block;
+        if (missing > 0) {
+            fill(missing);
+            continue;
+        }
+        const qint64 wait = (written + block - bufferFrames - due) * Q_INT64_C(1000000) / rate;
+        QThread::usleep(static_cast<unsigned long>(qMax<qint64>(wait, 100)));
+    }
+    /* still taken until close() */
+    m_header->state.store(FluidShmHeader::Suspended, std::memory_order_release);
+}
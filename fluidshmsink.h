@@ -0,0 +1,82 @@
+/*
+    Drumstick RT (realtime MIDI In/Out) FluidLite Backend
+    Copyright (C) 2022, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FLUIDSHMSINK_H_
+#define FLUIDSHMSINK_H_
+
+#include <QThread>
+#include <QSemaphore>
+#include <QString>
+#include <atomic>
+#include <vector>
+
+#include "fluidshmring.h"
+
+class FluidRenderer;
+
+/**
+ * Publishes the renderer in a POSIX shared memory ring, see fluidshmring.h,
+ * for other processes to read in place, for instance a mixer or a JACK
+ * client. There is no audio device: the thread renders straight into the
+ * ring in real time, staying bufferTime milliseconds ahead of the clock.
+ * When it falls behind, the readers run dry: the xrun is counted in the
+ * ring header and reported by the underrunDetected() signal.
+ */
+class FluidShmSink : public QThread
+{
+    Q_OBJECT
+
+public:
+    explicit FluidShmSink(FluidRenderer *renderer, QObject *parent = nullptr);
+    ~FluidShmSink();
+
+    bool open(const QString &name, int sampleRate, int channels, int bufferTime);
+    void close();
+    void stop();
+    void setSuspended(bool suspended);
+    QString name() const;
+    int sampleRate() const;
+    int capacity() const;
+    int bufferTime() const;
+    qint64 processedUSecs() const;
+    quint64 xruns() const;
+    QString errorString() const;
+
+signals:
+    void underrunDetected();
+
+protected:
+    void run() override;
+
+private:
+    static bool isStale(const char *path);
+    void fill(qint64 frames);
+
+    FluidRenderer *m_renderer;
+    QString m_name;
+    QString m_errorString;
+    FluidShmHeader *m_header;
+    size_t m_size;
+    int m_bufferTime;
+    std::vector<float> m_block; // a block rendered across the end of the ring
+    std::atomic<qint64> m_framesPlayed;
+    std::atomic<bool> m_suspended;
+    QSemaphore m_resumed;
+};
+
+#endif /*FLUIDSHMSINK_H_*/
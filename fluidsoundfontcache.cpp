@@ -0,0 +1,218 @@
+/*
+    Drumstick RT (realtime MIDI In/Out) FluidLite Backend
+    Copyright (C) 2022, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cstdio>
+#include <cstring>
+
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+
+#include "fluidsoundfontcache.h"
+
+/* FluidLite file API over a read only memory mapping */
+
+struct MappedFile
+{
+    QFile file;
+    const uchar *data;
+    qint64 size;
+    qint64 position;
+};
+
+static void *mapped_fopen(fluid_fileapi_t *fileapi, const char *filename)
+{
+    Q_UNUSED(fileapi)
+    MappedFile *mf = new MappedFile;
+    mf->file.setFileName(QString::fromLocal8Bit(filename));
+    mf->size = mf->file.size();
+    mf->position = 0;
+    mf->data = nullptr;
+    if (mf->file.open(QIODevice::ReadOnly)) {
+        mf->data = mf->file.map(0, mf->size);
+    }
+    if (mf->data == nullptr) {
+        delete mf;
+        return nullptr;
+    }
+    return mf;
+}
+
+static int mapped_fread(void *buf, int count, void *handle)
+{
+    MappedFile *mf = static_cast<MappedFile *>(handle);
+    if (count < 0 || mf->position + count > mf->size) {
+        return FLUID_FAILED;
+    }
+    std::memcpy(buf, mf->data + mf->position, count);
+    mf->position += count;
+    return FLUID_OK;
+}
+
+static int mapped_fseek(void *handle, long offset, int origin)
+{
+    MappedFile *mf = static_cast<MappedFile *>(handle);
+    qint64 position;
+    switch (origin) {
+    case SEEK_SET:
+        position = offset;
+        break;
+    case SEEK_CUR:
+        position = mf->position + offset;
+        break;
+    case SEEK_END:
+        position = mf->size + offset;
+        break;
+    default:
+        return FLUID_FAILED;
+    }
+    if (position < 0 || position > mf->size) {
+        return FLUID_FAILED;
+    }
+    mf->position = position;
+    return FLUID_OK;
+}
+
+static int mapped_fclose(void *handle)
+{
+    MappedFile *mf = static_cast<MappedFile *>(handle);
+    mf->file.unmap(const_cast<uchar *>(mf->data));
+    delete mf;
+    return FLUID_OK;
+}
+
+static long mapped_ftell(void *handle)
+{
+    return static_cast<long>(static_cast<MappedFile *>(handle)->position);
+}
+
+FluidSoundFontCache::FluidSoundFontCache()
+{
+    fluid_init_default_fileapi(&m_fileApi);
+    m_fileApi.fopen = mapped_fopen;
+    m_fileApi.fread = mapped_fread;
+    m_fileApi.fseek = mapped_fseek;
+    m_fileApi.fclose = mapped_fclose;
+    m_fileApi.ftell = mapped_ftell;
+    m_loader = new_fluid_defsfloader();
+    if (m_loader != nullptr) {
+        m_loader->fileapi = &m_fileApi;
+    }
+}
+
+FluidSoundFontCache::~FluidSoundFontCache()
+{
+    foreach(const Entry &entry, m_entries) {
+        delete_fluid_sfont(entry.sfont);
+    }
+    if (m_loader != nullptr && m_loader->free != nullptr) {
+        m_loader->free(m_loader);
+    }
+}
+
+FluidSoundFontCache *FluidSoundFontCache::instance()
+{
+    static FluidSoundFontCache cache;
+    return &cache;
+}
+
+fluid_sfont_t *FluidSoundFontCache::acquire(const QString &fileName, const void *owner)
+{
+    QFileInfo info(fileName);
+    if (!info.exists() || m_loader == nullptr) {
+        return nullptr;
+    }
+    const QString key = info.canonicalFilePath() + QLatin1Char('@') +
+                        QString::number(info.lastModified().toMSecsSinceEpoch());
+    QMutexLocker locker(&m_mutex);
+    purge();
+    for (Entry &entry : m_entries) {
+        if (entry.key == key && entry.owner == owner && entry.references > 0) {
+            entry.references++;
+            return entry.sfont;
+        }
+    }
+    fluid_sfont_t *sfont = m_loader->load(m_loader, info.canonicalFilePath().toLocal8Bit());
+    if (sfont != nullptr) {
+        Entry entry { key, owner, sfont, 1 };
+        m_entries.append(entry);
+    }
+    return sfont;
+}
+
+/* the last reference deletes the font, unless voices still use its samples */
+void FluidSoundFontCache::release(fluid_sfont_t *sfont)
+{
+    QMutexLocker locker(&m_mutex);
+    for (Entry &entry : m_entries) {
+        if (entry.sfont == sfont) {
+            entry.references--;
+            purge();
+            return;
+        }
+    }
+    /* not ours, e.g. loaded with fluid_synth_sfload() */
+    if (delete_fluid_sfont(sfont) != 0) {
+        Entry entry { QString(), nullptr, sfont, 0 };
+        m_entries.append(entry);
+    }
+}
+
+/* called with the mutex held: retries the fonts FluidLite refused to delete */
+void FluidSoundFontCache::purge()
+{
+    for (auto it = m_entries.begin(); it != m_entries.end(); ) {
+        if (it->references == 0 && delete_fluid_sfont(it->sfont) == 0) {
+            it = m_entries.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+/**
+ * Adds the SoundFont to the synth, shared with the other synths of the
+ * owner, returning its id or -1. The id is assigned by the synth; since
+ * each synth owns a single font, it is the same in every synth sharing it.
+ */
+int FluidSoundFontCache::attach(fluid_synth_t *synth, const QString &fileName, const void *owner)
+{
+    fluid_sfont_t *sfont = acquire(fileName, owner);
+    if (sfont == nullptr) {
+        return -1;
+    }
+    const int sfid = fluid_synth_add_sfont(synth, sfont);
+    fluid_synth_program_reset(synth);
+    return sfid;
+}
+
+/**
+ * Removes every SoundFont from the synth, releasing the shared ones, so
+ * that delete_fluid_synth() does not free the fonts other synths use.
+ */
+void FluidSoundFontCache::detach(fluid_synth_t *synth)
+{
+    /* the voices hold references to the samples until they are turned off */
+    fluid_synth_system_reset(synth);
+    fluid_sfont_t *sfont;
+    while ((sfont = fluid_synth_get_sfont(synth, 0)) != nullptr) {
+        fluid_synth_remove_sfont(synth, sfont);
+        release(sfont);
+    }
+}
@@ -0,0 +1,65 @@
+/*
+    Drumstick RT (realtime MIDI In/Out) FluidLite Backend
+    Copyright (C) 2022, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FLUIDSOUNDFONTCACHE_H_
+#define FLUIDSOUNDFONTCACHE_H_
+
+#include <QList>
+#include <QMutex>
+#include <QString>
+#include <fluidlite.h>
+
+/**
+ * Process wide, reference counted cache of loaded SoundFonts, keyed by the
+ * canonical file path and its modification time. The synths of one owner
+ * share one fluid_sfont_t, sample data included, so that swapping in a new
+ * synth does not load the file again. FluidLite counts the sample references
+ * of its voices without atomics, so synths rendering at the same time, like
+ * the partitions or other plugin instances, get their own fonts. Files are
+ * read through a memory mapped file API instead of stdio.
+ */
+class FluidSoundFontCache
+{
+public:
+    static FluidSoundFontCache *instance();
+
+    int attach(fluid_synth_t *synth, const QString &fileName, const void *owner);
+    void detach(fluid_synth_t *synth);
+
+private:
+    FluidSoundFontCache();
+    ~FluidSoundFontCache();
+    Q_DISABLE_COPY(FluidSoundFontCache)
+
+    fluid_sfont_t *acquire(const QString &fileName, const void *owner);
+    void release(fluid_sfont_t *sfont);
+    void purge();
+
+    struct Entry {
+        QString key;
+        const void *owner; // whose synths never render at the same time
+        fluid_sfont_t *sfont;
+        int references; // zero while FluidLite refuses to delete it
+    };
+    QMutex m_mutex;
+    QList<Entry> m_entries;
+    fluid_fileapi_t m_fileApi;
+    fluid_sfloader_t *m_loader;
+};
+
+#endif /*FLUIDSOUNDFONTCACHE_H_*/
@@ -0,0 +1,75 @@
+/*
+    Drumstick RT (realtime MIDI In/Out) FluidLite Backend
+    Copyright (C) 2022, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "fluidrenderer.h"
+#include "fluidsoundfontcache.h"
+#include "fluidsoundfontloader.h"
+
+FluidSoundFontLoader::FluidSoundFontLoader(FluidRenderer *renderer, const QString &fileName, QObject *parent):
+    QThread(parent),
+    m_renderer(renderer),
+    m_fileName(fileName),
+    m_succeeded(false)
+{
+    //qDebug() << Q_FUNC_INFO << fileName;
+}
+
+QString FluidSoundFontLoader::fileName() const
+{
+    return m_fileName;
+}
+
+bool FluidSoundFontLoader::succeeded() const
+{
+    return m_succeeded;
+}
+
+void FluidSoundFontLoader::run()
+{
+    //qDebug() << Q_FUNC_INFO << m_fileName;
+    fluid_synth_t *synth = new_fluid_synth(m_renderer->m_settings);
+    int sfid = -1;
+    if (synth != nullptr) {
+        sfid = FluidSoundFontCache::instance()->attach(synth, m_fileName, m_renderer);
+    }
+    if (sfid < 0 || isInterruptionRequested()) {
+        if (synth != nullptr) {
+            FluidRenderer::deleteSynth(synth);
+        }
+        return;
+    }
+    m_succeeded = true;
+    m_renderer->m_pendingSfid = sfid;
+    m_renderer->m_pendingSynth.store(synth, std::memory_order_release);
+    /* the swap happens on the audio thread, which a suspended sink doesn't pull */
+    m_renderer->wake();
+    /* wait until the previous synth has finished its release tail */
+    bool swapDone = false;
+    while (!isInterruptionRequested()) {
+        if (!swapDone && m_renderer->m_pendingSynth.load(std::memory_order_acquire) == nullptr) {
+            swapDone = true;
+            emit swapped();
+        }
+        fluid_synth_t *retired = m_renderer->m_retiredSynth.exchange(nullptr, std::memory_order_acq_rel);
+        if (retired != nullptr) {
+            FluidRenderer::deleteSynth(retired);
+            break;
+        }
+        QThread::msleep(20);
+    }
+}
@@ -0,0 +1,54 @@
+/*
+    Drumstick RT (realtime MIDI In/Out) FluidLite Backend
+    Copyright (C) 2022, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FLUIDSOUNDFONTLOADER_H_
+#define FLUIDSOUNDFONTLOADER_H_
+
+#include <QThread>
+#include <QString>
+
+class FluidRenderer;
+
+/**
+ * Loads a SoundFont into a new staging synth on a worker thread, hands it
+ * over to the renderer, and deletes the synth it replaced once the renderer
+ * has retired it, so neither loading nor freeing happen on the audio thread.
+ */
+class FluidSoundFontLoader : public QThread
+{
+    Q_OBJECT
+
+public:
+    explicit FluidSoundFontLoader(FluidRenderer *renderer, const QString &fileName, QObject *parent = nullptr);
+
+    QString fileName() const;
+    bool succeeded() const;
+
+signals:
+    void swapped();
+
+protected:
+    void run() override;
+
+private:
+    FluidRenderer *m_renderer;
+    QString m_fileName;
+    bool m_succeeded;
+};
+
+#endif /*FLUIDSOUNDFONTLOADER_H_*/
@@ -0,0 +1,261 @@
+/*
+    Drumstick RT (realtime MIDI In/Out) FluidLite Backend
+    Copyright (C) 2022, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <limits>
+
+#include <QtAlgorithms>
+
+#include "fluidstatistics.h"
+
+FluidHistogram::FluidHistogram()
+{
+    reset();
+}
+
+int FluidHistogram::bucketOf(quint64 value)
+{
+    if (value < 8) {
+        return static_cast<int>(value);
+    }
+    const int exponent = 63 - static_cast<int>(qCountLeadingZeroBits(value));
+    const int sub = static_cast<int>((value >> (exponent - 3)) & 7);
+    return (exponent - 2) * 8 + sub;
+}
+
+quint64 FluidHistogram::lowerBound(int bucket)
+{
+    if (bucket < 8) {
+        return static_cast<quint64>(bucket);
+    }
+    const int exponent = bucket / 8 + 2;
+    return static_cast<quint64>(8 + bucket % 8) << (exponent - 3);
+}
+
+void FluidHistogram::add(quint64 value)
+{
+    m_buckets[bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+    m_total.fetch_add(value, std::memory_order_relaxed);
+    if (value < m_minimum.load(std::memory_order_relaxed)) {
+        m_minimum.store(value, std::memory_order_relaxed);
+    }
+    if (value > m_maximum.load(std::memory_order_relaxed)) {
+        m_maximum.store(value, std::memory_order_relaxed);
+    }
+    m_count.fetch_add(1, std::memory_order_release);
+}
+
+void FluidHistogram::reset()
+{
+    for (int i = 0; i < BUCKETS; ++i) {
+        m_buckets[i].store(0, std::memory_order_relaxed);
+    }
+    m_total.store(0, std::memory_order_relaxed);
+    m_minimum.store(std::numeric_limits<quint64>::max(), std::memory_order_relaxed);
+    m_maximum.store(0, std::memory_order_relaxed);
+    m_count.store(0, std::memory_order_release);
+}
+
+quint64 FluidHistogram::count() const
+{
+    return m_count.load(std::memory_order_acquire);
+}
+
+quint64 FluidHistogram::minimum() const
+{
+    return count() > 0 ? m_minimum.load(std::memory_order_relaxed) : 0;
+}
+
+quint64 FluidHistogram::maximum() const
+{
+    return m_maximum.load(std::memory_order_relaxed);
+}
+
+double FluidHistogram::mean() const
+{
+    const quint64 n = count();
+    return n > 0 ? static_cast<double>(m_total.load(std::memory_order_relaxed)) / n : 0.0;
+}
+
+quint64 FluidHistogram::percentile(double p) const
+{
+    quint64 total = 0;
+    quint64 counts[BUCKETS];
+    for (int i = 0; i < BUCKETS; ++i) {
+        counts[i] = m_buckets[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+    const quint64 rank = static_cast<quint64>(p / 100.0 * total);
+    quint64 seen = 0;
+    for (int i = 0; i < BUCKETS; ++i) {
+        seen += counts[i];
+        if (seen > rank) {
+            return qMin(lowerBound(i + 1 < BUCKETS ? i + 1 : i), maximum());
+        }
+    }
+    return maximum();
+}
+
+/* values are divided by scale, e.g. 1000.0 to report nanoseconds as microseconds */
+QVariantMap FluidHistogram::summary(double scale) const
+{
+    QVariantMap result;
+    result["count"] = count();
+    result["min"] = minimum() / scale;
+    result["avg"] = mean() / scale;
+    result["max"] = maximum() / scale;
+    result["p50"] = percentile(50.0) / scale;
+    result["p99"] = percentile(99.0) / scale;
+    return result;
+}
+
+FluidRenderStats::FluidRenderStats()
+{
+    reset();
+}
+
+void FluidRenderStats::reset()
+{
+    m_blockTime.reset();
+    m_renderLatency.reset();
+    m_outputLatency.reset();
+    m_blocks.store(0, std::memory_order_relaxed);
+    m_events.store(0, std::memory_order_relaxed);
+    m_dropped.store(0, std::memory_order_relaxed);
+    m_voices.store(0, std::memory_order_relaxed);
+    m_peakVoices.store(0, std::memory_order_relaxed);
+    m_load.store(0.0f, std::memory_order_relaxed);
+    m_polyphony.store(0, std::memory_order_relaxed);
+    m_reductions.store(0, std::memory_order_relaxed);
+    m_restores.store(0, std::memory_order_relaxed);
+}
+
+void FluidRenderStats::addBlock(qint64 nsecs, qint64 budget, int events, int voices)
+{
+    m_blockTime.add(static_cast<quint64>(qMax<qint64>(0, nsecs)));
+    m_blocks.fetch_add(1, std::memory_order_relaxed);
+    m_events.fetch_add(static_cast<quint64>(events), std::memory_order_relaxed);
+    m_voices.store(voices, std::memory_order_relaxed);
+    if (voices > m_peakVoices.load(std::memory_order_relaxed)) {
+        m_peakVoices.store(voices, std::memory_order_relaxed);
+    }
+    if (budget > 0) {
+        /* exponential moving average over roughly the last 64 blocks */
+        const float load = static_cast<float>(nsecs) * 100.0f / static_cast<float>(budget);
+        const float smoothed = m_load.load(std::memory_order_relaxed);
+        m_load.store(smoothed + (load - smoothed) / 64.0f, std::memory_order_relaxed);
+    }
+}
+
+void FluidRenderStats::addDroppedEvent()
+{
+    m_dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+void FluidRenderStats::addRenderLatency(qint64 nsecs)
+{
+    m_renderLatency.add(static_cast<quint64>(qMax<qint64>(0, nsecs)));
+}
+
+void FluidRenderStats::addOutputLatency(qint64 nsecs)
+{
+    m_outputLatency.add(static_cast<quint64>(qMax<qint64>(0, nsecs)));
+}
+
+void FluidRenderStats::setPolyphony(int polyphony)
+{
+    m_polyphony.store(polyphony, std::memory_order_relaxed);
+}
+
+void FluidRenderStats::addGovernorAction(bool reduced, int polyphony)
+{
+    if (reduced) {
+        m_reductions.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        m_restores.fetch_add(1, std::memory_order_relaxed);
+    }
+    m_polyphony.store(polyphony, std::memory_order_relaxed);
+}
+
+quint64 FluidRenderStats::blocksRendered() const
+{
+    return m_blocks.load(std::memory_order_relaxed);
+}
+
+quint64 FluidRenderStats::eventsProcessed() const
+{
+    return m_events.load(std::memory_order_relaxed);
+}
+
+quint64 FluidRenderStats::eventsDropped() const
+{
+    return m_dropped.load(std::memory_order_relaxed);
+}
+
+int FluidRenderStats::activeVoices() const
+{
+    return m_voices.load(std::memory_order_relaxed);
+}
+
+int FluidRenderStats::peakVoices() const
+{
+    return m_peakVoices.load(std::memory_order_relaxed);
+}
+
+/* percentage of the real time budget of a block spent rendering it */
+double FluidRenderStats::dspLoad() const
+{
+    return m_load.load(std::memory_order_relaxed);
+}
+
+/* rendering time per block, in microseconds */
+QVariantMap FluidRenderStats::blockTime() const
+{
+    return m_blockTime.summary(1000.0);
+}
+
+/**
+ * Event to audio latency in milliseconds: "render" is the time from an event
+ * being sent until the block containing it was rendered, and "output" until
+ * the audio sink consumed that block.
+ */
+QVariantMap FluidRenderStats::latency() const
+{
+    QVariantMap result;
+    result["render"] = m_renderLatency.summary(1000000.0);
+    result["output"] = m_outputLatency.summary(1000000.0);
+    return result;
+}
+
+/* the polyphony limit in effect, lower than the configured one while governed */
+int FluidRenderStats::polyphony() const
+{
+    return m_polyphony.load(std::memory_order_relaxed);
+}
+
+quint64 FluidRenderStats::governorReductions() const
+{
+    return m_reductions.load(std::memory_order_relaxed);
+}
+
+quint64 FluidRenderStats::governorRestores() const
+{
+    return m_restores.load(std::memory_order_relaxed);
+}
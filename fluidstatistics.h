@@ -0,0 +1,103 @@
+/*
+    Drumstick RT (realtime MIDI In/Out) FluidLite Backend
+    Copyright (C) 2022, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FLUIDSTATISTICS_H_
+#define FLUIDSTATISTICS_H_
+
+#include <QtGlobal>
+#include <QVariantMap>
+#include <atomic>
+
+/**
+ * Log-linear histogram of non negative values, with eight sub-buckets per
+ * power of two (about 12% resolution). add() is meant to be called by a
+ * single thread, while any thread may read the summary.
+ */
+class FluidHistogram
+{
+public:
+    FluidHistogram();
+
+    void add(quint64 value);
+    void reset();
+
+    quint64 count() const;
+    quint64 minimum() const;
+    quint64 maximum() const;
+    double mean() const;
+    quint64 percentile(double p) const;
+    QVariantMap summary(double scale = 1.0) const;
+
+    static const int BUCKETS = 496;
+
+private:
+    static int bucketOf(quint64 value);
+    static quint64 lowerBound(int bucket);
+
+    std::atomic<quint64> m_buckets[BUCKETS];
+    std::atomic<quint64> m_count;
+    std::atomic<quint64> m_total;
+    std::atomic<quint64> m_minimum;
+    std::atomic<quint64> m_maximum;
+};
+
+/**
+ * Render path counters, written by the rendering thread and polled by
+ * anybody else without locks.
+ */
+class FluidRenderStats
+{
+public:
+    FluidRenderStats();
+
+    void reset();
+    void addBlock(qint64 nsecs, qint64 budget, int events, int voices);
+    void addDroppedEvent();
+    void addRenderLatency(qint64 nsecs);
+    void addOutputLatency(qint64 nsecs);
+    void setPolyphony(int polyphony);
+    void addGovernorAction(bool reduced, int polyphony);
+
+    quint64 blocksRendered() const;
+    quint64 eventsProcessed() const;
+    quint64 eventsDropped() const;
+    int activeVoices() const;
+    int peakVoices() const;
+    double dspLoad() const;
+    QVariantMap blockTime() const;
+    QVariantMap latency() const;
+    int polyphony() const;
+    quint64 governorReductions() const;
+    quint64 governorRestores() const;
+
+private:
+    FluidHistogram m_blockTime;
+    FluidHistogram m_renderLatency; // written by the rendering thread
+    FluidHistogram m_outputLatency; // written by the controller thread
+    std::atomic<quint64> m_blocks;
+    std::atomic<quint64> m_events;
+    std::atomic<quint64> m_dropped;
+    std::atomic<int> m_voices;
+    std::atomic<int> m_peakVoices;
+    std::atomic<float> m_load; // percent, smoothed
+    std::atomic<int> m_polyphony; // effective limit, after the governor
+    std::atomic<quint64> m_reductions;
+    std::atomic<quint64> m_restores;
+};
+
+#endif /*FLUIDSTATISTICS_H_*/